@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Adaptive connection interval
+ */
+
+#include <string.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include <zephyr/logging/log.h>
+
+#include "conn_interval.h"
+
+LOG_MODULE_REGISTER(conn_interval, LOG_LEVEL_INF);
+
+#define CONN_IDLE_TIMEOUT K_MSEC(CONFIG_BRIDGE_CONN_IDLE_TIMEOUT_MS)
+
+enum conn_interval_state {
+	CONN_INTERVAL_ACTIVE,
+	CONN_INTERVAL_IDLE,
+	CONN_INTERVAL_STATE_COUNT,
+};
+
+struct conn_interval_ctx {
+	struct bt_conn *conn;
+	struct k_work active_work;
+	struct k_work_delayable idle_work;
+	enum conn_interval_state state;
+	int64_t state_start;
+	int64_t state_time[CONN_INTERVAL_STATE_COUNT];
+	uint32_t transitions;
+	atomic_t frames;
+};
+
+static struct conn_interval_ctx contexts[CONFIG_BT_MAX_CONN];
+
+static const struct bt_le_conn_param active_param =
+	BT_LE_CONN_PARAM_INIT(CONFIG_BRIDGE_CONN_ACTIVE_INTERVAL_MIN,
+			      CONFIG_BRIDGE_CONN_ACTIVE_INTERVAL_MAX,
+			      0,
+			      CONFIG_BRIDGE_CONN_SUPERVISION_TIMEOUT);
+
+static const struct bt_le_conn_param idle_param =
+	BT_LE_CONN_PARAM_INIT(CONFIG_BRIDGE_CONN_IDLE_INTERVAL_MIN,
+			      CONFIG_BRIDGE_CONN_IDLE_INTERVAL_MAX,
+			      CONFIG_BRIDGE_CONN_IDLE_LATENCY,
+			      CONFIG_BRIDGE_CONN_SUPERVISION_TIMEOUT);
+
+static const char *const state_str[] = {
+	[CONN_INTERVAL_ACTIVE] = "active",
+	[CONN_INTERVAL_IDLE] = "idle",
+};
+
+static struct conn_interval_ctx *ctx_get(struct bt_conn *conn)
+{
+	return &contexts[bt_conn_index(conn)];
+}
+
+static void state_set(struct conn_interval_ctx *ctx, enum conn_interval_state state)
+{
+	const struct bt_le_conn_param *param;
+	int64_t now = k_uptime_get();
+	int64_t elapsed = now - ctx->state_start;
+	uint32_t frames;
+	int err;
+
+	if (!ctx->conn || (ctx->state == state)) {
+		return;
+	}
+
+	frames = atomic_clear(&ctx->frames);
+	ctx->state_time[ctx->state] += elapsed;
+	ctx->state_start = now;
+	ctx->state = state;
+	ctx->transitions++;
+
+	param = (state == CONN_INTERVAL_ACTIVE) ? &active_param : &idle_param;
+	err = bt_conn_le_param_update(ctx->conn, param);
+	if (err) {
+		LOG_WRN("Connection parameter update failed (err %d)", err);
+	}
+
+	LOG_INF("Connection %s after %u ms, %u frames (%u transitions, "
+		"active %u ms, idle %u ms)",
+		state_str[state], (uint32_t)elapsed, frames, ctx->transitions,
+		(uint32_t)ctx->state_time[CONN_INTERVAL_ACTIVE],
+		(uint32_t)ctx->state_time[CONN_INTERVAL_IDLE]);
+}
+
+static void active_work_handler(struct k_work *work)
+{
+	struct conn_interval_ctx *ctx = CONTAINER_OF(work, struct conn_interval_ctx,
+						     active_work);
+
+	state_set(ctx, CONN_INTERVAL_ACTIVE);
+}
+
+static void idle_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct conn_interval_ctx *ctx = CONTAINER_OF(dwork, struct conn_interval_ctx,
+						     idle_work);
+
+	state_set(ctx, CONN_INTERVAL_IDLE);
+}
+
+void conn_interval_activity(struct bt_conn *conn)
+{
+	struct conn_interval_ctx *ctx;
+
+	if (!conn) {
+		return;
+	}
+
+	ctx = ctx_get(conn);
+	if (ctx->conn != conn) {
+		/* Not connected yet, or already disconnected. */
+		return;
+	}
+
+	atomic_inc(&ctx->frames);
+
+	/* State changes are made from the system workqueue only. */
+	if (ctx->state != CONN_INTERVAL_ACTIVE) {
+		k_work_submit(&ctx->active_work);
+	}
+
+	k_work_reschedule(&ctx->idle_work, CONN_IDLE_TIMEOUT);
+}
+
+static void connected(struct bt_conn *conn, uint8_t conn_err)
+{
+	struct conn_interval_ctx *ctx;
+
+	if (conn_err) {
+		return;
+	}
+
+	ctx = ctx_get(conn);
+	atomic_clear(&ctx->frames);
+	memset(ctx->state_time, 0, sizeof(ctx->state_time));
+	ctx->transitions = 0;
+
+	/* The connection starts with the parameters of the scan module, which
+	 * are short enough for service discovery. The idle parameters are
+	 * requested if no frame is bridged before the idle timeout.
+	 */
+	ctx->state = CONN_INTERVAL_ACTIVE;
+	ctx->state_start = k_uptime_get();
+	ctx->conn = bt_conn_ref(conn);
+	k_work_reschedule(&ctx->idle_work, CONN_IDLE_TIMEOUT);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct conn_interval_ctx *ctx = ctx_get(conn);
+
+	if (!ctx->conn) {
+		return;
+	}
+
+	k_work_cancel(&ctx->active_work);
+	k_work_cancel_delayable(&ctx->idle_work);
+
+	ctx->state_time[ctx->state] += k_uptime_get() - ctx->state_start;
+	LOG_INF("Connection closed (%u transitions, active %u ms, idle %u ms)",
+		ctx->transitions, (uint32_t)ctx->state_time[CONN_INTERVAL_ACTIVE],
+		(uint32_t)ctx->state_time[CONN_INTERVAL_IDLE]);
+
+	bt_conn_unref(ctx->conn);
+	ctx->conn = NULL;
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	LOG_INF("Connection parameters updated: interval %u.%02u ms, latency %u, "
+		"timeout %u ms", (interval * 125) / 100, (interval * 125) % 100,
+		latency, timeout * 10);
+}
+
+static int conn_interval_init(void)
+{
+	/* The work items are initialized once, as they may still be queued
+	 * when a connection context is reused.
+	 */
+	for (size_t i = 0; i < ARRAY_SIZE(contexts); i++) {
+		k_work_init(&contexts[i].active_work, active_work_handler);
+		k_work_init_delayable(&contexts[i].idle_work, idle_work_handler);
+	}
+
+	return 0;
+}
+
+SYS_INIT(conn_interval_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+BT_CONN_CB_DEFINE(conn_interval_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_updated = le_param_updated,
+};
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef CONN_INTERVAL_H_
+#define CONN_INTERVAL_H_
+
+/** @file
+ *  @brief Adaptive connection interval
+ *
+ *  Requests a short connection interval while Modbus frames are bridged
+ *  to a peripheral, and a long connection interval with peripheral latency
+ *  once the connection has been idle for a while.
+ */
+
+#include <zephyr/bluetooth/conn.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(CONFIG_BRIDGE_CONN_INTERVAL_ADAPTIVE)
+/** @brief Report a frame bridged to a peripheral.
+ *
+ *  Switches the connection to the active parameters if it was idle, and
+ *  restarts the idle timeout.
+ *
+ *  @param conn Connection the frame is sent on.
+ */
+void conn_interval_activity(struct bt_conn *conn);
+#else
+static inline void conn_interval_activity(struct bt_conn *conn)
+{
+	ARG_UNUSED(conn);
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONN_INTERVAL_H_ */
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef CRC16_MODBUS_H_
+#define CRC16_MODBUS_H_
+
+/** @file
+ *  @brief CRC-16/MODBUS engine
+ *
+ *  Reflected polynomial 0x8005, seed 0xFFFF and no final XOR. The CRC is
+ *  appended to the frame in little-endian order, so the CRC calculated over
+ *  a valid frame including its CRC is zero.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Initial CRC value. */
+#define CRC16_MODBUS_SEED 0xFFFF
+
+/** @brief Incremental CRC calculation context. */
+struct crc16_modbus_ctx {
+	uint16_t crc;
+};
+
+/** @brief Start a new CRC calculation.
+ *
+ *  @param ctx Calculation context.
+ */
+static inline void crc16_modbus_init(struct crc16_modbus_ctx *ctx)
+{
+	ctx->crc = CRC16_MODBUS_SEED;
+}
+
+/** @brief Add data to a CRC calculation.
+ *
+ *  Can be called from interrupt context, for example with each chunk of
+ *  data received by the UART.
+ *
+ *  @param ctx Calculation context.
+ *  @param data Data to add.
+ *  @param len Length of the data.
+ */
+void crc16_modbus_update(struct crc16_modbus_ctx *ctx, const uint8_t *data, size_t len);
+
+/** @brief Get the result of a CRC calculation.
+ *
+ *  @param ctx Calculation context.
+ *
+ *  @return CRC over all data added since @ref crc16_modbus_init.
+ */
+static inline uint16_t crc16_modbus_final(const struct crc16_modbus_ctx *ctx)
+{
+	return ctx->crc;
+}
+
+/** @brief Calculate the CRC over a buffer.
+ *
+ *  @param data Data to calculate the CRC over.
+ *  @param len Length of the data.
+ *
+ *  @return CRC value.
+ */
+uint16_t crc16_modbus(const uint8_t *data, size_t len);
+
+/** @brief Bitwise implementation, one shift per bit. */
+uint16_t crc16_modbus_bitwise(uint16_t crc, const uint8_t *data, size_t len);
+
+/** @brief Table implementation, one lookup per byte. */
+uint16_t crc16_modbus_table(uint16_t crc, const uint8_t *data, size_t len);
+
+#if defined(CONFIG_BRIDGE_CRC16_SLICE_TABLES)
+/** @brief Slice-by-4 implementation, four lookups per four bytes. */
+uint16_t crc16_modbus_slice4(uint16_t crc, const uint8_t *data, size_t len);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRC16_MODBUS_H_ */
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief L2CAP connection-oriented channel transport
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/l2cap.h>
+
+#include <zephyr/logging/log.h>
+
+#include "l2cap_transport.h"
+
+LOG_MODULE_REGISTER(l2cap_transport, LOG_LEVEL_INF);
+
+#define L2CAP_TX_BUF_TIMEOUT K_MSEC(500)
+
+NET_BUF_POOL_FIXED_DEFINE(sdu_tx_pool, CONFIG_BRIDGE_L2CAP_TX_BUF_COUNT,
+			  BT_L2CAP_SDU_BUF_SIZE(CONFIG_BRIDGE_L2CAP_SDU_MTU),
+			  CONFIG_BT_CONN_TX_USER_DATA_SIZE, NULL);
+NET_BUF_POOL_FIXED_DEFINE(sdu_rx_pool, 1, CONFIG_BRIDGE_L2CAP_SDU_MTU, 8, NULL);
+
+static struct bt_l2cap_le_chan le_chan;
+static l2cap_transport_recv_cb_t recv_cb;
+static atomic_t chan_ready;
+
+static struct net_buf *chan_alloc_buf(struct bt_l2cap_chan *chan)
+{
+	ARG_UNUSED(chan);
+
+	return net_buf_alloc(&sdu_rx_pool, K_FOREVER);
+}
+
+static int chan_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+	LOG_DBG("L2CAP data rcvd, len: %u", buf->len);
+
+	if (recv_cb) {
+		recv_cb(chan->conn, buf->data, buf->len);
+	}
+
+	/* The buffer is released and the credit returned to the peer. */
+	return 0;
+}
+
+static void chan_connected(struct bt_l2cap_chan *chan)
+{
+	struct bt_conn *conn = chan->conn;
+	int err;
+
+	LOG_INF("L2CAP channel connected, tx MTU %u MPS %u, rx MTU %u MPS %u",
+		le_chan.tx.mtu, le_chan.tx.mps, le_chan.rx.mtu, le_chan.rx.mps);
+
+	atomic_set(&chan_ready, true);
+
+	/* Make use of the larger SDUs with the fastest PHY and the longest
+	 * link layer packets.
+	 */
+	if (IS_ENABLED(CONFIG_BT_USER_PHY_UPDATE)) {
+		err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+		if (err) {
+			LOG_WRN("PHY update failed (err %d)", err);
+		}
+	}
+
+	if (IS_ENABLED(CONFIG_BT_USER_DATA_LEN_UPDATE)) {
+		err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+		if (err) {
+			LOG_WRN("Data length update failed (err %d)", err);
+		}
+	}
+}
+
+static void chan_disconnected(struct bt_l2cap_chan *chan)
+{
+	ARG_UNUSED(chan);
+
+	if (atomic_set(&chan_ready, false)) {
+		LOG_INF("L2CAP channel disconnected");
+	} else {
+		LOG_INF("L2CAP channel refused, using NUS");
+	}
+}
+
+static const struct bt_l2cap_chan_ops chan_ops = {
+	.alloc_buf = chan_alloc_buf,
+	.recv = chan_recv,
+	.connected = chan_connected,
+	.disconnected = chan_disconnected,
+};
+
+void l2cap_transport_init(l2cap_transport_recv_cb_t cb)
+{
+	recv_cb = cb;
+}
+
+int l2cap_transport_connect(struct bt_conn *conn)
+{
+	int err;
+
+	if (le_chan.chan.conn) {
+		return -EALREADY;
+	}
+
+	memset(&le_chan, 0, sizeof(le_chan));
+	le_chan.chan.ops = &chan_ops;
+	le_chan.rx.mtu = CONFIG_BRIDGE_L2CAP_SDU_MTU;
+
+	err = bt_l2cap_chan_connect(conn, &le_chan.chan, CONFIG_BRIDGE_L2CAP_PSM);
+	if (err) {
+		LOG_WRN("L2CAP channel connect failed (err %d)", err);
+		return err;
+	}
+
+	LOG_INF("Connecting L2CAP channel, PSM 0x%04X", CONFIG_BRIDGE_L2CAP_PSM);
+	return 0;
+}
+
+bool l2cap_transport_ready(struct bt_conn *conn)
+{
+	return atomic_get(&chan_ready) && (le_chan.chan.conn == conn);
+}
+
+int l2cap_transport_send(const uint8_t *data, uint16_t len)
+{
+	uint16_t loc = 0;
+	int err;
+
+	if (!atomic_get(&chan_ready)) {
+		return -ENOTCONN;
+	}
+
+	while (loc < len) {
+		uint16_t plen = MIN(len - loc, MIN(le_chan.tx.mtu,
+						   CONFIG_BRIDGE_L2CAP_SDU_MTU));
+		struct net_buf *buf;
+
+		/* Waiting for a buffer throttles the sender when the peer runs
+		 * out of credits.
+		 */
+		buf = net_buf_alloc(&sdu_tx_pool, L2CAP_TX_BUF_TIMEOUT);
+		if (!buf) {
+			return -ENOBUFS;
+		}
+
+		net_buf_reserve(buf, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+		net_buf_add_mem(buf, &data[loc], plen);
+
+		err = bt_l2cap_chan_send(&le_chan.chan, buf);
+		if (err < 0) {
+			net_buf_unref(buf);
+			return err;
+		}
+
+		loc += plen;
+	}
+
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef L2CAP_TRANSPORT_H_
+#define L2CAP_TRANSPORT_H_
+
+/** @file
+ *  @brief L2CAP connection-oriented channel transport
+ *
+ *  Carries the bridged data over an LE credit-based L2CAP channel instead
+ *  of NUS GATT writes and notifications. Large SDUs are segmented by the
+ *  host and flow controlled with credits, which avoids the ATT overhead.
+ *  NUS is used when the peripheral does not accept the channel.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <zephyr/bluetooth/conn.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Callback for data received on the channel.
+ *
+ *  @param conn Connection the channel is open on.
+ *  @param data Received SDU.
+ *  @param len Length of the SDU.
+ */
+typedef void (*l2cap_transport_recv_cb_t)(struct bt_conn *conn, const uint8_t *data,
+					  uint16_t len);
+
+#if defined(CONFIG_BRIDGE_L2CAP)
+/** @brief Initialize the transport.
+ *
+ *  @param recv_cb Callback for received data.
+ */
+void l2cap_transport_init(l2cap_transport_recv_cb_t recv_cb);
+
+/** @brief Open the channel to the peripheral.
+ *
+ *  A single channel is supported, to the first peripheral that accepts it.
+ *
+ *  @param conn Connection to the peripheral.
+ *
+ *  @retval 0 The connection procedure was started.
+ *  @retval -EALREADY The channel is in use with another peripheral.
+ *  @return Other negative error code on failure.
+ */
+int l2cap_transport_connect(struct bt_conn *conn);
+
+/** @brief Check if the channel is connected to a peripheral.
+ *
+ *  @param conn Connection to the peripheral.
+ *
+ *  @return true if data for the peripheral should be sent with
+ *          @ref l2cap_transport_send.
+ */
+bool l2cap_transport_ready(struct bt_conn *conn);
+
+/** @brief Send data over the channel.
+ *
+ *  Data larger than the peer MTU is split into several SDUs. Blocks while
+ *  no transmit buffer is available.
+ *
+ *  @param data Data to send.
+ *  @param len Length of the data.
+ *
+ *  @return 0 on success, negative error code otherwise.
+ */
+int l2cap_transport_send(const uint8_t *data, uint16_t len);
+#else
+static inline void l2cap_transport_init(l2cap_transport_recv_cb_t recv_cb)
+{
+	ARG_UNUSED(recv_cb);
+}
+
+static inline int l2cap_transport_connect(struct bt_conn *conn)
+{
+	ARG_UNUSED(conn);
+	return -ENOTSUP;
+}
+
+static inline bool l2cap_transport_ready(struct bt_conn *conn)
+{
+	ARG_UNUSED(conn);
+	return false;
+}
+
+static inline int l2cap_transport_send(const uint8_t *data, uint16_t len)
+{
+	ARG_UNUSED(data);
+	ARG_UNUSED(len);
+	return -ENOTSUP;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* L2CAP_TRANSPORT_H_ */
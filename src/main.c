@@ -7,9 +7,8 @@
 /** @file
  *  @brief Nordic UART Service Client sample
  */
-#include <uart_async_adapter.h>
-
 #include <errno.h>
+#include <string.h>
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
@@ -25,321 +24,473 @@
 #include <bluetooth/services/nus.h>
 #include <bluetooth/services/nus_client.h>
 #include <bluetooth/gatt_dm.h>
-#include <bluetooth/scan.h>
 
 #include <zephyr/settings/settings.h>
 
-#include <zephyr/drivers/uart.h>
-
 #include <zephyr/logging/log.h>
 
 #include <cmsis_core.h>
 #include <zephyr/arch/arm/exception.h>
 
+#include "conn_interval.h"
+#include "crc16_modbus.h"
+#include "l2cap_transport.h"
+#include "modbus.h"
+#include "scan.h"
+#include "uart_bridge.h"
+
 #define LOG_MODULE_NAME central_uart
 LOG_MODULE_REGISTER(LOG_MODULE_NAME, LOG_LEVEL_DBG);
 
-#define STACKSIZE 4096
 #define PRIORITY 7
 
-/* UART payload buffer element size. */
-// #define UART_BUF_SIZE 384
-#define UART_BUF_SIZE 740
 #define BT_NUS_UART_BUFFER_SIZE 40
 
 #define KEY_PASSKEY_ACCEPT DK_BTN1_MSK
 #define KEY_PASSKEY_REJECT DK_BTN2_MSK
 
 #define NUS_WRITE_TIMEOUT K_MSEC(150)
-#define UART_WAIT_FOR_BUF_DELAY K_MSEC(50)
-#define UART_RX_TIMEOUT 50000 /* Wait for RX complete event time in microseconds. */
+#define ATT_WRITE_CMD_HDR_LEN 3 /* Opcode and attribute handle. */
 
-static const struct device *uart = DEVICE_DT_GET(DT_CHOSEN(nordic_nus_uart));
-static struct k_work_delayable uart_work;
+/* Longest peripheral device name matched against the bridge peer names. */
+#define PEER_NAME_MAX 32
 
-K_SEM_DEFINE(nus_write_sem, 0, 1);
 static K_SEM_DEFINE(ble_init_ok, 0, 1);
 
-#ifdef CONFIG_UART_ASYNC_ADAPTER
-UART_ASYNC_ADAPTER_INST_DEFINE(async_adapter);
+/* Connected peripheral, with the NUS client used to reach it. */
+struct bridge_peer {
+	struct bt_conn *conn;
+	struct bt_nus_client nus;
+	struct bt_gatt_exchange_params exchange_params;
+	struct bt_gatt_read_params name_params;
+	/* Device name, matched against the peer name of the bridges. */
+	char name[PEER_NAME_MAX + 1];
+	/* Set once NUS has been discovered and the name has been read. */
+	bool ready;
+	/* Serializes the frames sent by several bridges. */
+	struct k_mutex send_lock;
+	struct k_sem write_sem;
+	/* Bridge that sent the last request, the responses are sent to it. */
+	struct uart_bridge *owner;
+	/* Bridge whose request waits for its response, with RTU framing. */
+	atomic_ptr_t holder;
+	/* Given when the holder is released. */
+	struct k_sem rsp_sem;
+	/* Response being routed by transaction ID, with compact framing. */
+	struct modbus_rsp_parser rsp_parser;
+	struct uart_bridge *rsp_bridge;
+	int64_t rsp_time;
+};
+
+static struct bridge_peer peers[CONFIG_BT_MAX_CONN];
+
+static K_THREAD_STACK_ARRAY_DEFINE(bridge_stacks, UART_BRIDGE_COUNT,
+				   CONFIG_BRIDGE_UART_THREAD_STACK_SIZE);
+static struct k_thread bridge_threads[UART_BRIDGE_COUNT];
+
+/* Broadcast fanned out to the peripherals, reported once sent on all links.
+ * Each broadcast has its own context, released once every link has sent it
+ * or disconnected, so the next one can be issued while the previous one is
+ * in flight.
+ */
+struct broadcast {
+	atomic_t in_use;
+	/* Peers, by connection index, the broadcast is still to be sent to. */
+	ATOMIC_DEFINE(owed, CONFIG_BT_MAX_CONN);
+	atomic_t pending;
+	atomic_t sent;
+	uint32_t peers;
+	uint32_t start;
+};
+
+#if defined(CONFIG_BRIDGE_BROADCAST_FANOUT)
+#define BROADCAST_MAX_PENDING CONFIG_BRIDGE_BROADCAST_MAX_PENDING
 #else
-#define async_adapter NULL
+#define BROADCAST_MAX_PENDING 1
 #endif
 
-struct uart_data_t {
-	void *fifo_reserved;
-	uint8_t  data[UART_BUF_SIZE];
-	uint16_t len;
-};
-struct nus_data_t{
-	void *fifo_reserved;
-	uint8_t data[BT_NUS_UART_BUFFER_SIZE];
-	uint16_t len;
-};
+static struct broadcast broadcasts[BROADCAST_MAX_PENDING];
+static K_SEM_DEFINE(broadcast_free, BROADCAST_MAX_PENDING, BROADCAST_MAX_PENDING);
 
-static K_FIFO_DEFINE(fifo_uart_tx_data);
-static K_FIFO_DEFINE(fifo_uart_rx_data);
+/* Longest broadcast cycle time so far. */
+static atomic_t broadcast_max_us;
 
-static struct bt_conn *default_conn;
-static struct bt_nus_client nus_client;
+static void broadcast_free_put(struct broadcast *bc)
+{
+	atomic_clear(&bc->in_use);
+	k_sem_give(&broadcast_free);
+}
 
-static void ble_data_sent(struct bt_nus_client *nus, uint8_t err,
-					const uint8_t *const data, uint16_t len)
+static void broadcast_done(struct broadcast *bc)
 {
-	ARG_UNUSED(nus);
-	ARG_UNUSED(data);
-	// ARG_UNUSED(len);
-	LOG_DBG("BLE data sent, len: %d", len);
-	k_sem_give(&nus_write_sem);
+	uint32_t cycle_us;
+	atomic_val_t max_us;
 
-	if (err) {
-		LOG_WRN("ATT error code: 0x%02X", err);
+	if (atomic_dec(&bc->pending) != 1) {
+		return;
 	}
+
+	cycle_us = k_cyc_to_us_floor32(k_cycle_get_32() - bc->start);
+	do {
+		max_us = atomic_get(&broadcast_max_us);
+	} while ((cycle_us > max_us) && !atomic_cas(&broadcast_max_us, max_us, cycle_us));
+
+	LOG_INF("Broadcast sent to %u/%u peripherals in %u us (max %u us)",
+		(uint32_t)atomic_get(&bc->sent), bc->peers, cycle_us,
+		(uint32_t)atomic_get(&broadcast_max_us));
+
+	broadcast_free_put(bc);
 }
 
-static uint8_t ble_data_received(struct bt_nus_client *nus,
-						const uint8_t *data, uint16_t len)
+static struct broadcast *broadcast_alloc(void)
 {
-	ARG_UNUSED(nus);
-	// int err;
-	// LOG_DBG("BLE data rcvd, len: %d", len);
-	struct nus_data_t *buf = k_malloc(sizeof(*buf));
-	if (!buf) {
-		LOG_WRN("Not able to allocate UART send data buffer");
-		return BT_GATT_ITER_CONTINUE;
-	}
-	memcpy(&buf->data, data, len);
-	// LOG_DBG("UART TX Len: %d", tx->len);		
-	// LOG_DBG("UART TX Pos: %d", pos);
-	// err = uart_tx(uart, tx->data, tx->len, SYS_FOREVER_MS);
-	// if (err) {
-	// 	LOG_DBG("UART TX err: %d", err);		
-	// 	k_fifo_put(&fifo_uart_tx_data, tx);
-	// }
-	buf->len = len;
-
-	LOG_DBG("UART TX -> FIFO, len: %u", buf->len);
-	k_fifo_put(&fifo_uart_tx_data, buf);
+	/* Wait for a previous broadcast to complete if all contexts are in
+	 * use.
+	 */
+	if (k_sem_take(&broadcast_free, NUS_WRITE_TIMEOUT)) {
+		return NULL;
+	}
 
-	return BT_GATT_ITER_CONTINUE;
+	for (size_t i = 0; i < ARRAY_SIZE(broadcasts); i++) {
+		if (atomic_cas(&broadcasts[i].in_use, 0, 1)) {
+			return &broadcasts[i];
+		}
+	}
+
+	__ASSERT_NO_MSG(false);
+	return NULL;
 }
 
-static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+/* Each peer is accounted for once, whether the broadcast was sent to it,
+ * failed, or the peer disconnected first.
+ */
+static void broadcast_sent(struct bt_conn *conn, void *user_data)
 {
-	ARG_UNUSED(dev);
+	struct broadcast *bc = user_data;
 
-	static size_t aborted_len;
-	struct uart_data_t *buf;
-	static uint8_t *aborted_buf;
-	static bool disable_req;
-
-	switch (evt->type) {
-	case UART_TX_DONE:
-		LOG_DBG("UART_TX_DONE");
-		if ((evt->data.tx.len == 0) ||
-		    (!evt->data.tx.buf)) {
-			return;
-		}
+	if (atomic_test_and_clear_bit(bc->owed, bt_conn_index(conn))) {
+		atomic_inc(&bc->sent);
+		broadcast_done(bc);
+	}
+}
 
-		if (aborted_buf) {
-			buf = CONTAINER_OF(aborted_buf, struct uart_data_t,
-					   data[0]);
-			aborted_buf = NULL;
-			aborted_len = 0;
-		} else {
-			buf = CONTAINER_OF(evt->data.tx.buf,
-					   struct uart_data_t,
-					   data[0]);
+/* The host drops the sent callbacks of a disconnected link, so the
+ * broadcasts still owed to the peer are completed here.
+ */
+static void broadcast_peer_lost(struct bt_conn *conn)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(broadcasts); i++) {
+		if (atomic_test_and_clear_bit(broadcasts[i].owed, bt_conn_index(conn))) {
+			broadcast_done(&broadcasts[i]);
 		}
+	}
+}
 
-		k_free(buf);
+static struct bridge_peer *peer_get(struct bt_conn *conn)
+{
+	return &peers[bt_conn_index(conn)];
+}
+
+/* A peripheral is claimed by the bridges naming it as their peer. */
+static struct uart_bridge *peer_claimant(const struct bridge_peer *peer)
+{
+	for (size_t i = 0; i < UART_BRIDGE_COUNT; i++) {
+		struct uart_bridge *bridge = uart_bridge_get(i);
 
-		// buf = k_fifo_get(&fifo_uart_tx_data, K_NO_WAIT);
-		// // buf = k_fifo_get(&fifo_uart_tx_data, K_MSEC(5));
-		// if (!buf) {
-		// 	return;
-		// }
+		if (bridge->peer_name && !strcmp(bridge->peer_name, peer->name)) {
+			return bridge;
+		}
+	}
 
-		// if (uart_tx(uart, buf->data, buf->len, SYS_FOREVER_MS)) {
-		// 	LOG_WRN("Failed to send data over UART");
-		// }
+	return NULL;
+}
 
-		break;
+/* Bridges without a peer name reach the peripherals not claimed by another
+ * bridge.
+ */
+static bool peer_reachable(const struct uart_bridge *bridge, const struct bridge_peer *peer)
+{
+	if (!peer->conn || !peer->ready) {
+		return false;
+	}
 
-	case UART_RX_RDY:
-		LOG_DBG("UART_RX_RDY");
-		buf = CONTAINER_OF(evt->data.rx.buf, struct uart_data_t, data[0]);
-		buf->len += evt->data.rx.len;
-		LOG_DBG("UART_RX_RDY, len: %d", evt->data.rx.len);
+	return bridge->peer_name ? !strcmp(bridge->peer_name, peer->name) :
+				   !peer_claimant(peer);
+}
 
-		if (disable_req) {
-			return;
+/* Find the peripheral a bridge sends its requests to. */
+static struct bridge_peer *bridge_peer_find(const struct uart_bridge *bridge)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+		if (peer_reachable(bridge, &peers[i])) {
+			return &peers[i];
 		}
+	}
 
-		// if ((evt->data.rx.buf[buf->len - 1] == '\n') ||
-		//     (evt->data.rx.buf[buf->len - 1] == '\r')) {
-		// 	disable_req = true;
-		// 	uart_rx_disable(uart);
-		// }
-		disable_req = true;
-		uart_rx_disable(uart);
+	return NULL;
+}
 
-		break;
+/* Find the bridge data from a peripheral is sent to, before any request
+ * has been sent to it.
+ */
+static struct uart_bridge *peer_owner_get(struct bridge_peer *peer)
+{
+	struct uart_bridge *bridge;
 
-	case UART_RX_DISABLED:
-		LOG_DBG("UART_RX_DISABLED");
-		disable_req = false;
+	if (peer->owner) {
+		return peer->owner;
+	}
 
-		buf = k_malloc(sizeof(*buf));
-		if (buf) {
-			buf->len = 0;
-		} else {
-			LOG_WRN("Not able to allocate UART receive buffer");
-			k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
-			return;
+	bridge = peer_claimant(peer);
+	if (bridge) {
+		return bridge;
+	}
+
+	for (size_t i = 0; i < UART_BRIDGE_COUNT; i++) {
+		bridge = uart_bridge_get(i);
+		if (!bridge->peer_name) {
+			return bridge;
 		}
+	}
 
-		uart_rx_enable(uart, buf->data, sizeof(buf->data),
-			       UART_RX_TIMEOUT);
+	return uart_bridge_get(0);
+}
 
-		break;
+/* With compact framing, the transaction IDs are unique across the bridges
+ * and identify the bridge a response is sent to.
+ */
+static struct uart_bridge *tid_bridge_find(uint8_t tid)
+{
+	for (size_t i = 0; i < UART_BRIDGE_COUNT; i++) {
+		struct uart_bridge *bridge = uart_bridge_get(i);
 
-	case UART_RX_BUF_REQUEST:
-		LOG_DBG("UART_RX_BUF_REQUEST");
-		buf = k_malloc(sizeof(*buf));
-		if (buf) {
-			buf->len = 0;
-			uart_rx_buf_rsp(uart, buf->data, sizeof(buf->data));
-		} else {
-			LOG_WRN("Not able to allocate UART receive buffer");
+		if (modbus_req_pending(&bridge->reqs, tid)) {
+			return bridge;
 		}
+	}
+
+	return NULL;
+}
 
-		break;
+/* Take the peripheral for a request, with its send lock held. Returns a
+ * reference to the connection, held until the request has been sent, or
+ * NULL with the lock released if the peripheral is no longer reachable.
+ *
+ * With RTU framing, a response does not identify its request, so a
+ * peripheral shared by several bridges serves one request at a time. It is
+ * held by the bridge of the request until the response has been framed, or
+ * until the response timeout.
+ */
+static struct bt_conn *peer_acquire(struct bridge_peer *peer, struct uart_bridge *bridge,
+				    uint8_t unit)
+{
+	k_timepoint_t end = sys_timepoint_calc(K_MSEC(CONFIG_BRIDGE_RESPONSE_TIMEOUT_MS));
+	bool serialize = IS_ENABLED(CONFIG_BRIDGE_MODBUS_FRAMING) &&
+			 !IS_ENABLED(CONFIG_BRIDGE_COMPACT_FRAMING) &&
+			 (unit != MODBUS_UNIT_BROADCAST);
 
-	case UART_RX_BUF_RELEASED:
-		buf = CONTAINER_OF(evt->data.rx_buf.buf, struct uart_data_t,
-				   data[0]);
-		LOG_DBG("UART_RX_BUF_RELEASED, len: %d", buf->len);
+	for (;;) {
+		k_mutex_lock(&peer->send_lock, K_FOREVER);
+		if (!peer_reachable(bridge, peer)) {
+			k_mutex_unlock(&peer->send_lock);
+			return NULL;
+		}
 
-		if (buf->len > 0) {
-			k_fifo_put(&fifo_uart_rx_data, buf);
-		} else {
-			k_free(buf);
+		/* A master sending its next request has given up on the
+		 * previous one.
+		 */
+		if (!serialize || atomic_ptr_cas(&peer->holder, NULL, bridge) ||
+		    (atomic_ptr_get(&peer->holder) == bridge)) {
+			break;
 		}
 
-		break;
+		k_mutex_unlock(&peer->send_lock);
+
+		if (k_sem_take(&peer->rsp_sem, sys_timepoint_timeout(end))) {
+			LOG_WRN("No response to the previous request, taking over the peripheral");
 
-	case UART_TX_ABORTED:
-		LOG_DBG("UART_TX_ABORTED");
-		if (!aborted_buf) {
-			aborted_buf = (uint8_t *)evt->data.tx.buf;
+			k_mutex_lock(&peer->send_lock, K_FOREVER);
+			if (!peer_reachable(bridge, peer)) {
+				k_mutex_unlock(&peer->send_lock);
+				return NULL;
+			}
+
+			atomic_ptr_set(&peer->holder, bridge);
+			break;
 		}
+	}
 
-		aborted_len += evt->data.tx.len;
-		buf = CONTAINER_OF((void *)aborted_buf, struct uart_data_t,
-				   data);
-        // LOG_DBG("retry UART TX Len: %d", buf->len - aborted_len);	
-		uart_tx(uart, &buf->data[aborted_len],
-			buf->len - aborted_len, SYS_FOREVER_MS);
+	peer->owner = bridge;
 
-		break;
+	return bt_conn_ref(peer->conn);
+}
 
-	default:
-		break;
-	}
+static void peer_release(struct bridge_peer *peer, struct bt_conn *conn)
+{
+	bt_conn_unref(conn);
+	k_mutex_unlock(&peer->send_lock);
 }
 
-static void uart_work_handler(struct k_work *item)
+/* Release the peripheral that sent a response, if the bridge holds it. */
+static void bridge_rsp_done(struct uart_bridge *bridge, void *user_data)
 {
-	struct uart_data_t *buf;
+	struct bridge_peer *peer = user_data;
 
-	buf = k_malloc(sizeof(*buf));
-	if (buf) {
-		buf->len = 0;
-	} else {
-		LOG_WRN("Not able to allocate UART receive buffer(work handler)");
-		k_work_reschedule(&uart_work, UART_WAIT_FOR_BUF_DELAY);
-		return;
+	if (atomic_ptr_cas(&peer->holder, bridge, NULL)) {
+		k_sem_give(&peer->rsp_sem);
 	}
-
-	uart_rx_enable(uart, buf->data, sizeof(buf->data), UART_RX_TIMEOUT);
 }
 
-static bool uart_test_async_api(const struct device *dev)
+/* Startup milestones in milliseconds since boot, reported together with
+ * the time to the first bridged frame.
+ */
+static struct {
+	int64_t bt_ready;
+	int64_t scan_started;
+	int64_t connected;
+	atomic_t first_frame;
+} startup;
+
+static void startup_frame_bridged(const struct uart_bridge *bridge)
 {
-	const struct uart_driver_api *api =
-			(const struct uart_driver_api *)dev->api;
+	if (!atomic_cas(&startup.first_frame, 0, 1)) {
+		return;
+	}
 
-	return (api->callback_set != NULL);
+	LOG_INF("Time to first bridged frame: %u ms (Bluetooth ready %u ms, "
+		"scanning %u ms, connected %u ms, UART ready %u ms)",
+		(uint32_t)k_uptime_get(), (uint32_t)startup.bt_ready,
+		(uint32_t)startup.scan_started, (uint32_t)startup.connected,
+		(uint32_t)bridge->ready_time);
 }
 
-static int uart_init(void)
+static void ble_data_sent(struct bt_nus_client *nus, uint8_t err,
+					const uint8_t *const data, uint16_t len)
 {
-	int err;
-	struct uart_data_t *rx;
+	struct bridge_peer *peer = CONTAINER_OF(nus, struct bridge_peer, nus);
 
-	if (!device_is_ready(uart)) {
-		LOG_ERR("UART device not ready");
-		return -ENODEV;
-	}
+	ARG_UNUSED(data);
+	LOG_DBG("BLE data sent, len: %d", len);
+	k_sem_give(&peer->write_sem);
 
-	rx = k_malloc(sizeof(*rx));
-	if (rx) {
-		rx->len = 0;
-	} else {
-		return -ENOMEM;
+	if (err) {
+		LOG_WRN("ATT error code: 0x%02X", err);
 	}
+}
 
-	k_work_init_delayable(&uart_work, uart_work_handler);
-	
-	if (IS_ENABLED(CONFIG_UART_ASYNC_ADAPTER) && !uart_test_async_api(uart)) {
-		/* Implement API adapter */
-		uart_async_adapter_init(async_adapter, uart);
-		uart = async_adapter;
+/* Queue data received from a peripheral for the UART of its bridge,
+ * whichever transport it arrived on. With compact framing, the responses
+ * are framed as they arrive, and each of them is sent to the bridge that
+ * holds its transaction ID.
+ */
+static void ble_data_put(struct bridge_peer *peer, const uint8_t *data, uint16_t len)
+{
+	int64_t now = k_uptime_get();
+
+	if (!IS_ENABLED(CONFIG_BRIDGE_COMPACT_FRAMING)) {
+		(void)uart_bridge_put(peer_owner_get(peer), data, len, peer);
+		return;
 	}
 
-	err = uart_callback_set(uart, uart_cb, NULL);
-	if (err) {
-		return err;
+	/* The bridge flushes a response left incomplete for the frame
+	 * timeout, the next data starts a new response.
+	 */
+	if (peer->rsp_bridge && ((now - peer->rsp_time) > CONFIG_BRIDGE_FRAME_TIMEOUT_MS)) {
+		peer->rsp_bridge = NULL;
 	}
-	if (IS_ENABLED(CONFIG_UART_LINE_CTRL)) {
-		LOG_INF("Wait for DTR");
-		while (true) {
-			uint32_t dtr = 0;
+	peer->rsp_time = now;
 
-			uart_line_ctrl_get(uart, UART_LINE_CTRL_DTR, &dtr);
-			if (dtr) {
-				break;
+	while (len) {
+		enum modbus_rsp_status status;
+		size_t used;
+
+		if (!peer->rsp_bridge) {
+			peer->rsp_bridge = tid_bridge_find(data[0]);
+			if (!peer->rsp_bridge) {
+				peer->rsp_bridge = peer_owner_get(peer);
 			}
-			/* Give CPU resources to low priority threads. */
-			k_sleep(K_MSEC(100));
+
+			modbus_rsp_parser_init(&peer->rsp_parser, NULL);
 		}
-		
-		LOG_INF("DTR set");
-		err = uart_line_ctrl_set(uart, UART_LINE_CTRL_DCD, 1);
-		if (err) {
-			LOG_WRN("Failed to set DCD, ret code %d", err);
+
+		status = modbus_rsp_parser_feed(&peer->rsp_parser, data, len, &used);
+		if (used == 0) {
+			used = len;
 		}
-		err = uart_line_ctrl_set(uart, UART_LINE_CTRL_DSR, 1);
-		if (err) {
-			LOG_WRN("Failed to set DSR, ret code %d", err);
+
+		(void)uart_bridge_put(peer->rsp_bridge, data, used, peer);
+
+		/* Data that cannot be framed is used up to the end of the
+		 * packet, and goes to the same bridge.
+		 */
+		if (status != MODBUS_RSP_INCOMPLETE) {
+			peer->rsp_bridge = NULL;
 		}
+
+		data += used;
+		len -= used;
 	}
-	
-	err = uart_rx_enable(uart, rx->data, sizeof(rx->data), UART_RX_TIMEOUT);
+}
+
+static uint8_t ble_data_received(struct bt_nus_client *nus,
+						const uint8_t *data, uint16_t len)
+{
+	ble_data_put(CONTAINER_OF(nus, struct bridge_peer, nus), data, len);
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static void l2cap_data_received(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+	ble_data_put(peer_get(conn), data, len);
+}
+
+static uint8_t name_read_cb(struct bt_conn *conn, uint8_t err,
+			    struct bt_gatt_read_params *params,
+			    const void *data, uint16_t length)
+{
+	struct bridge_peer *peer = CONTAINER_OF(params, struct bridge_peer, name_params);
+
+	ARG_UNUSED(conn);
+
 	if (err) {
-		LOG_ERR("Cannot enable uart reception (err: %d)", err);
-		/* Free the rx buffer only because the tx buffer will be handled in the callback */
-		k_free(rx);
+		LOG_WRN("Failed to read the device name (err %u)", err);
+	} else if (data) {
+		length = MIN(length, PEER_NAME_MAX);
+		memcpy(peer->name, data, length);
+		peer->name[length] = '\0';
+		LOG_INF("Peripheral name: %s", peer->name);
 	}
 
-	return err;
+	peer->ready = true;
+
+	return BT_GATT_ITER_STOP;
+}
+
+/* The device name selects the bridge the peripheral is serving. */
+static void name_read(struct bridge_peer *peer)
+{
+	int err;
+
+	peer->name_params.func = name_read_cb;
+	peer->name_params.handle_count = 0;
+	peer->name_params.by_uuid.uuid = BT_UUID_GAP_DEVICE_NAME;
+	peer->name_params.by_uuid.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+	peer->name_params.by_uuid.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+
+	err = bt_gatt_read(peer->conn, &peer->name_params);
+	if (err) {
+		LOG_WRN("Failed to read the device name (err %d)", err);
+		peer->ready = true;
+	}
 }
 
 static void discovery_complete(struct bt_gatt_dm *dm,
 			       void *context)
 {
 	struct bt_nus_client *nus = context;
+	struct bridge_peer *peer = CONTAINER_OF(nus, struct bridge_peer, nus);
+	struct bt_conn *conn = bt_gatt_dm_conn_get(dm);
 	LOG_INF("Service discovery completed");
 
 	bt_gatt_dm_data_print(dm);
@@ -347,7 +498,17 @@ static void discovery_complete(struct bt_gatt_dm *dm,
 	bt_nus_handles_assign(dm, nus);
 	bt_nus_subscribe_receive(nus);
 
+	/* NUS stays subscribed as the fallback if the peripheral does not
+	 * accept the L2CAP channel. The channel is opened to the first
+	 * peripheral only.
+	 */
+	if (IS_ENABLED(CONFIG_BRIDGE_L2CAP)) {
+		(void)l2cap_transport_connect(conn);
+	}
+
 	bt_gatt_dm_data_release(dm);
+
+	name_read(peer);
 }
 
 static void discovery_service_not_found(struct bt_conn *conn,
@@ -371,16 +532,17 @@ struct bt_gatt_dm_cb discovery_cb = {
 
 static void gatt_discover(struct bt_conn *conn)
 {
+	struct bridge_peer *peer = peer_get(conn);
 	int err;
 
-	if (conn != default_conn) {
+	if (peer->conn != conn) {
 		return;
 	}
 
 	err = bt_gatt_dm_start(conn,
 			       BT_UUID_NUS_SERVICE,
 			       &discovery_cb,
-			       &nus_client);
+			       &peer->nus);
 	if (err) {
 		LOG_ERR("could not start the discovery procedure, error "
 			"code: %d", err);
@@ -401,33 +563,32 @@ static void exchange_func(struct bt_conn *conn, uint8_t err, struct bt_gatt_exch
 static void connected(struct bt_conn *conn, uint8_t conn_err)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
+	struct bridge_peer *peer;
 	int err;
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
+	/* Scanning is restarted by the scan module. */
 	if (conn_err) {
 		LOG_INF("Failed to connect to %s (%d)", addr, conn_err);
-
-		if (default_conn == conn) {
-			bt_conn_unref(default_conn);
-			default_conn = NULL;
-
-			err = bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
-			if (err) {
-				LOG_ERR("Scanning failed to start (err %d)",
-					err);
-			}
-		}
-
 		return;
 	}
 
 	LOG_INF("Connected: %s", addr);
 
-	static struct bt_gatt_exchange_params exchange_params;
+	if (!startup.connected) {
+		startup.connected = k_uptime_get();
+	}
+
+	peer = peer_get(conn);
+	peer->conn = bt_conn_ref(conn);
+	peer->name[0] = '\0';
+	peer->ready = false;
+	peer->owner = NULL;
+	peer->rsp_bridge = NULL;
 
-	exchange_params.func = exchange_func;
-	err = bt_gatt_exchange_mtu(conn, &exchange_params);
+	peer->exchange_params.func = exchange_func;
+	err = bt_gatt_exchange_mtu(conn, &peer->exchange_params);
 	if (err) {
 		LOG_WRN("MTU exchange failed (err %d)", err);
 	}
@@ -438,33 +599,34 @@ static void connected(struct bt_conn *conn, uint8_t conn_err)
 
 		gatt_discover(conn);
 	}
-
-	err = bt_scan_stop();
-	if ((!err) && (err != -EALREADY)) {
-		LOG_ERR("Stop LE scan failed (err %d)", err);
-	}
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
-	int err;
+	struct bridge_peer *peer = peer_get(conn);
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
 	LOG_INF("Disconnected: %s (reason %u)", addr, reason);
 
-	if (default_conn != conn) {
+	if (peer->conn != conn) {
 		return;
 	}
 
-	bt_conn_unref(default_conn);
-	default_conn = NULL;
+	/* Bridges without a peer name move over to another connected
+	 * peripheral, if any.
+	 */
+	peer->ready = false;
+	bt_conn_unref(peer->conn);
+	peer->conn = NULL;
 
-	err = bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
-	if (err) {
-		LOG_ERR("Scanning failed to start (err %d)",
-			err);
+	/* No response will come, release a bridge waiting for the peer. */
+	atomic_ptr_clear(&peer->holder);
+	k_sem_give(&peer->rsp_sem);
+
+	if (IS_ENABLED(CONFIG_BRIDGE_BROADCAST_FANOUT)) {
+		broadcast_peer_lost(conn);
 	}
 }
 
@@ -491,29 +653,6 @@ BT_CONN_CB_DEFINE(conn_callbacks) = {
 	.security_changed = security_changed
 };
 
-static void scan_filter_match(struct bt_scan_device_info *device_info,
-			      struct bt_scan_filter_match *filter_match,
-			      bool connectable)
-{
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(device_info->recv_info->addr, addr, sizeof(addr));
-
-	LOG_INF("Filters matched. Address: %s connectable: %d",
-		addr, connectable);
-}
-
-static void scan_connecting_error(struct bt_scan_device_info *device_info)
-{
-	LOG_WRN("Connecting failed");
-}
-
-static void scan_connecting(struct bt_scan_device_info *device_info,
-			    struct bt_conn *conn)
-{
-	default_conn = bt_conn_ref(conn);
-}
-
 static int nus_client_init(void)
 {
 	int err;
@@ -524,46 +663,22 @@ static int nus_client_init(void)
 		}
 	};
 
-	err = bt_nus_client_init(&nus_client, &init);
-	if (err) {
-		LOG_ERR("NUS Client initialization failed (err %d)", err);
-		return err;
-	}
+	for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+		k_mutex_init(&peers[i].send_lock);
+		k_sem_init(&peers[i].write_sem, 0, 1);
+		k_sem_init(&peers[i].rsp_sem, 0, 1);
 
-	LOG_INF("NUS Client module initialized");
-	return err;
-}
-
-BT_SCAN_CB_INIT(scan_cb, scan_filter_match, NULL,
-		scan_connecting_error, scan_connecting);
-
-static int scan_init(void)
-{
-	int err;
-	struct bt_scan_init_param scan_init = {
-		.connect_if_match = 1,
-	};
-
-	bt_scan_init(&scan_init);
-	bt_scan_cb_register(&scan_cb);
-
-	err = bt_scan_filter_add(BT_SCAN_FILTER_TYPE_UUID, BT_UUID_NUS_SERVICE);
-	if (err) {
-		LOG_ERR("Scanning filters cannot be set (err %d)", err);
-		return err;
-	}
-
-	err = bt_scan_filter_enable(BT_SCAN_UUID_FILTER, false);
-	if (err) {
-		LOG_ERR("Filters cannot be turned on (err %d)", err);
-		return err;
+		err = bt_nus_client_init(&peers[i].nus, &init);
+		if (err) {
+			LOG_ERR("NUS Client initialization failed (err %d)", err);
+			return err;
+		}
 	}
 
-	LOG_INF("Scan module initialized");
+	LOG_INF("NUS Client module initialized");
 	return err;
 }
 
-
 static void auth_cancel(struct bt_conn *conn)
 {
 	char addr[BT_ADDR_LE_STR_LEN];
@@ -602,6 +717,246 @@ static struct bt_conn_auth_info_cb conn_auth_info_callbacks = {
 	.pairing_failed = pairing_failed
 };
 
+static void bt_ready(int err)
+{
+	if (err) {
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+		return;
+	}
+
+	startup.bt_ready = k_uptime_get();
+	LOG_INF("Bluetooth initialized");
+
+	if (IS_ENABLED(CONFIG_SETTINGS)) {
+		settings_load();
+	}
+
+	k_sem_give(&ble_init_ok);
+
+	err = scan_init();
+	if (err != 0) {
+		LOG_ERR("scan_init failed (err %d)", err);
+		return;
+	}
+
+	err = scan_start();
+	if (err) {
+		return;
+	}
+
+	startup.scan_started = k_uptime_get();
+	LOG_INF("Scanning successfully started");
+}
+
+static int peer_send(struct bridge_peer *peer, struct bt_conn *conn,
+		     const uint8_t *data, uint16_t len)
+{
+	uint8_t nus_tx_buf[BT_NUS_UART_BUFFER_SIZE];
+	int err = 0;
+
+	if (l2cap_transport_ready(conn)) {
+		err = l2cap_transport_send(data, len);
+		if (err) {
+			LOG_WRN("Failed to send data over L2CAP channel "
+				"(err %d)", err);
+		}
+
+		return err;
+	}
+
+	for (uint16_t loc = 0, plen; loc < len; loc += plen) {
+		plen = MIN(sizeof(nus_tx_buf), len - loc);
+		memcpy(nus_tx_buf, &data[loc], plen);
+
+		err = bt_nus_client_send(&peer->nus, nus_tx_buf, plen);
+		if (err) {
+			LOG_WRN("Failed to send data over BLE connection"
+				"(err %d)", err);
+		}
+
+		err = k_sem_take(&peer->write_sem, NUS_WRITE_TIMEOUT);
+		if (err) {
+			LOG_WRN("NUS send timeout");
+		}
+	}
+
+	return err;
+}
+
+/* Send a broadcast request to every peripheral the bridge reaches. The
+ * requests are not answered, so they are sent with Write Without Response
+ * and each chunk is issued to all peripherals before the next one. The
+ * links carry the chunks in their next connection events in parallel,
+ * and the cycle time does not grow with the number of peripherals.
+ */
+static int broadcast_send(const struct uart_bridge *bridge, const uint8_t *data, uint16_t len)
+{
+	struct bridge_peer *targets[ARRAY_SIZE(peers)];
+	struct bt_conn *conns[ARRAY_SIZE(peers)];
+	uint16_t chunk = UINT16_MAX;
+	struct broadcast *bc;
+	size_t count = 0;
+	int err;
+
+	bc = broadcast_alloc();
+	if (!bc) {
+		LOG_WRN("Previous broadcasts not completed, dropping broadcast");
+		return -ENOMEM;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(peers); i++) {
+		struct bridge_peer *peer = &peers[i];
+
+		if (!peer_reachable(bridge, peer)) {
+			continue;
+		}
+
+		/* Chunks from other bridges must not interleave with the
+		 * broadcast. The locks are taken in peer order. The peripheral
+		 * may have disconnected while waiting for the lock, and the
+		 * connection is held until the last chunk has been issued.
+		 */
+		k_mutex_lock(&peer->send_lock, K_FOREVER);
+		if (!peer_reachable(bridge, peer)) {
+			k_mutex_unlock(&peer->send_lock);
+			continue;
+		}
+
+		conns[count] = bt_conn_ref(peer->conn);
+		conn_interval_activity(conns[count]);
+		chunk = MIN(chunk, bt_gatt_get_mtu(conns[count]) - ATT_WRITE_CMD_HDR_LEN);
+		targets[count++] = peer;
+	}
+
+	if (!count) {
+		broadcast_free_put(bc);
+		return -ENOTCONN;
+	}
+
+	bc->peers = count;
+	bc->start = k_cycle_get_32();
+	atomic_clear(&bc->sent);
+	/* One extra count keeps the broadcast pending while it is issued. */
+	atomic_set(&bc->pending, count + 1);
+	for (size_t i = 0; i < count; i++) {
+		atomic_set_bit(bc->owed, bt_conn_index(conns[i]));
+	}
+
+	for (uint16_t loc = 0, plen; loc < len; loc += plen) {
+		bool last;
+
+		plen = MIN(chunk, len - loc);
+		last = (loc + plen) == len;
+
+		for (size_t i = 0; i < count; i++) {
+			struct bridge_peer *peer = targets[i];
+
+			if (!peer) {
+				continue;
+			}
+
+			err = bt_gatt_write_without_response_cb(conns[i], peer->nus.handles.rx,
+								&data[loc], plen, false,
+								last ? broadcast_sent : NULL,
+								last ? bc : NULL);
+			if (err) {
+				LOG_WRN("Failed to send broadcast (err %d)", err);
+				k_mutex_unlock(&peer->send_lock);
+				if (atomic_test_and_clear_bit(bc->owed, bt_conn_index(conns[i]))) {
+					broadcast_done(bc);
+				}
+				bt_conn_unref(conns[i]);
+				targets[i] = NULL;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (targets[i]) {
+			k_mutex_unlock(&targets[i]->send_lock);
+			bt_conn_unref(conns[i]);
+		}
+	}
+
+	broadcast_done(bc);
+
+	return 0;
+}
+
+static void bridge_thread(void *p1, void *p2, void *p3)
+{
+	struct uart_bridge *bridge = p1;
+	struct bridge_peer *peer = NULL;
+	struct uart_data_t *buf;
+	bool fanout;
+	uint8_t unit;
+	int err;
+
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	for (;;) {
+		/* Wait indefinitely for data to be sent over Bluetooth */
+		buf = k_fifo_get(&bridge->rx_fifo, K_FOREVER);
+		unit = buf->data[0];
+
+		if (!uart_bridge_unit_allowed(bridge, unit)) {
+			LOG_WRN("Unit %u not served by %s, dropping UART frame",
+				unit, bridge->uart->name);
+			uart_bridge_free(bridge, buf);
+			continue;
+		}
+
+		fanout = IS_ENABLED(CONFIG_BRIDGE_BROADCAST_FANOUT) &&
+			 (unit == MODBUS_UNIT_BROADCAST);
+		if (!fanout) {
+			peer = bridge_peer_find(bridge);
+			if (!peer) {
+				LOG_WRN("No peripheral connected, dropping UART data");
+				uart_bridge_free(bridge, buf);
+				continue;
+			}
+		}
+
+		if (IS_ENABLED(CONFIG_BRIDGE_COMPACT_FRAMING)) {
+			err = modbus_rtu_to_compact(&bridge->reqs, buf->data, buf->len,
+						    crc16_modbus_final(&buf->crc));
+			if (err < 0) {
+				LOG_WRN("Dropping UART frame (err %d)", err);
+				uart_bridge_free(bridge, buf);
+				continue;
+			}
+			buf->len = err;
+		} else {
+			modbus_req_track(&bridge->reqs, buf->data, buf->len);
+		}
+
+		if (fanout) {
+			err = broadcast_send(bridge, buf->data, buf->len);
+			if (err == -ENOTCONN) {
+				LOG_WRN("No peripheral connected, dropping broadcast");
+			}
+		} else {
+			struct bt_conn *conn = peer_acquire(peer, bridge, unit);
+
+			if (conn) {
+				conn_interval_activity(conn);
+				err = peer_send(peer, conn, buf->data, buf->len);
+				peer_release(peer, conn);
+			} else {
+				LOG_WRN("Peripheral disconnected, dropping UART data");
+				err = -ENOTCONN;
+			}
+		}
+
+		if (!err) {
+			startup_frame_bridged(bridge);
+		}
+
+		uart_bridge_free(bridge, buf);
+	}
+}
+
 int debug_mon_enable(void)
 {
 	/*
@@ -629,12 +984,6 @@ int main(void)
 		return 0;
 	}
 
-	err = uart_init();
-	if (err != 0) {
-		LOG_ERR("uart_init failed (err %d)", err);
-		return 0;
-	}
-
 	err = bt_conn_auth_cb_register(&conn_auth_callbacks);
 	if (err) {
 		LOG_ERR("Failed to register authorization callbacks.");
@@ -647,216 +996,39 @@ int main(void)
 		return 0;
 	}
 
-	err = bt_enable(NULL);
-	if (err) {
-		LOG_ERR("Bluetooth init failed (err %d)", err);
-		return 0;
-	}
-	LOG_INF("Bluetooth initialized");
-
-	if (IS_ENABLED(CONFIG_SETTINGS)) {
-		settings_load();
-	}
-	LOG_INF("Bluetooth initialized");
-
-	k_sem_give(&ble_init_ok);
-	err = scan_init();
-	if (err != 0) {
-		LOG_ERR("scan_init failed (err %d)", err);
-		return 0;
-	}
-
 	err = nus_client_init();
 	if (err != 0) {
 		LOG_ERR("nus_client_init failed (err %d)", err);
 		return 0;
 	}
 
-	printk("Starting Bluetooth Central UART example\n");
+	l2cap_transport_init(l2cap_data_received);
 
-	err = bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
+	/* The controller comes up while the UART is set up, scanning is
+	 * started from bt_ready().
+	 */
+	err = bt_enable(bt_ready);
 	if (err) {
-		LOG_ERR("Scanning failed to start (err %d)", err);
+		LOG_ERR("Bluetooth init failed (err %d)", err);
 		return 0;
 	}
 
-	LOG_INF("Scanning successfully started");
-
-	struct nus_data_t nus_data = {
-		.len = 0,
-	};
-	for (;;) {
-		/* Wait indefinitely for data to be sent over Bluetooth */
-		struct uart_data_t *buf = k_fifo_get(&fifo_uart_rx_data,
-						     K_FOREVER);
-
-		int plen = MIN(sizeof(nus_data.data) - nus_data.len, buf->len);
-		int loc = 0;
-
-		while (plen > 0) {
-			memcpy(&nus_data.data[nus_data.len], &buf->data[loc], plen);
-			nus_data.len += plen;
-			loc += plen;
-			// if (nus_data.len >= sizeof(nus_data.data)) {
-			err = bt_nus_client_send(&nus_client, nus_data.data, nus_data.len);
-			if (err) {
-				LOG_WRN("Failed to send data over BLE connection"
-					"(err %d)", err);
-			}
-
-			err = k_sem_take(&nus_write_sem, NUS_WRITE_TIMEOUT);
-			if (err) {
-				LOG_WRN("NUS send timeout");
-			}
-
-			nus_data.len = 0;
-			// }
-
-			plen = MIN(sizeof(nus_data.data), buf->len - loc);
-		}
-
-		k_free(buf);
+	err = uart_bridge_init(bridge_rsp_done);
+	if (err != 0) {
+		LOG_ERR("uart_bridge_init failed (err %d)", err);
+		return 0;
 	}
-}
-void ble_read_thread(void)
-{
-	// struct uart_data_t uart_data = {
-	// 	.len = 0,
-	// };
-	int32_t err = 0;
-	volatile uint8_t i = 0;
-	volatile uint8_t j = 0;
-	volatile uint16_t uart_loc = 0;
-	volatile uint16_t nus_loc = 0;
-	volatile bool buffer_full = false;
-	volatile size_t plen = 0;
-
-	// uint8_t *uart_buf;
-	// uint8_t *uart_buf = NULL;
-	// size_t uart_buf_size = (size_t)(sizeof(uint8_t) * UART_BUF_SIZE);
-	size_t uart_buf_size = sizeof(struct uart_data_t);
 
-	// err = sizeof(buf);
-	struct nus_data_t *buffer[10] = {NULL};
-	// *buf = k_malloc(sizeof(*buf));
+	printk("Starting Bluetooth Central UART example\n");
 
-	// struct nus_data_t *test = k_malloc(sizeof(*test));
-	// struct nus_data_t *test2 = NULL;
-	for (;;) {
-		/* Wait indefinitely for data to be sent over Bluetooth */
-		i = 0;
-		j = 0;
-		buffer[i] = k_fifo_get(&fifo_uart_tx_data, K_FOREVER);
-		// LOG_DBG("buffer[%d], addr: 0x%X size: %hu len: %hu", i, (uint32_t)&buffer[i], sizeof(*buffer[i]), buffer[i]->len);
-
-		struct uart_data_t *uart_buf = k_malloc(uart_buf_size);
-		if(!uart_buf){
-			LOG_WRN("Could not allocate UART tx buffer!");
-			k_free(buffer[i]);
-			break;
-		}
-		memset(&uart_buf->data, 0, sizeof(uart_buf->data));
-		uart_buf->len = 0;
-		
-		i++;
-		//wait for all data
-		// LOG_DBG("wait for all data");
-		k_msleep(50);
-		// int is_empty = k_fifo_is_empty(&fifo_uart_tx_data);
-		// (void)is_empty;
-		while(!k_fifo_is_empty(&fifo_uart_tx_data)){
-			buffer[i] = k_fifo_get(&fifo_uart_tx_data, K_MSEC(50));
-			// test = k_fifo_get(&fifo_uart_tx_data, K_MSEC(50));
-			if(buffer[i]){
-				// LOG_DBG("Fetched uart tx buffer from fifo, len: %u", buffer[i]->len);
-				// LOG_DBG("buffer[%d], addr: 0x%X size: %hu len: %hu", i, (uint32_t)&buffer[i], sizeof(*buffer[i]), buffer[i]->len);
-				// test = NULL;
-				i++;
-			}
-			else{
-				LOG_DBG("could not fetch buffer from fifo!");
-			}
-		}
-		buffer[i] = 0;
-		// LOG_DBG("Fetched uart tx buffers from fifo");		
-		// Pack data into UART TX buffer and send
-		plen = 0;
-		uart_loc = 0;
-		nus_loc = 0;
-
-		do{
-			while(!buffer_full){
-				// LOG_DBG("uart_buf_size: %hu, uart_buf->len: %hu, buffer[j]->len: %hu, nus_loc: %hu", 
-				// (uint16_t)uart_buf_size, (uint16_t)uart_buf->len, (uint16_t)buffer[j]->len, (uint16_t)nus_loc);
-				// LOG_DBG("uart_buf_size - uart_buf->len = %hu, buffer[j]->len - nus_loc = %hu", sizeof(uart_buf->data) - uart_buf->len, buffer[j]->len - nus_loc);
-				plen = MIN(sizeof(uart_buf->data) - uart_buf->len, buffer[j]->len - nus_loc);
-				// LOG_DBG("Filling uart_buf, uart_buf->len:%hu plen: %hu", uart_buf->len, plen);
-				memcpy(&uart_buf->data[uart_buf->len], &(buffer[j]->data[nus_loc]), plen);
-				
-				if(sizeof(uart_buf->data) <= (uart_buf->len + plen)){
-					// uart buffer is full				
-					buffer_full = true;
-					LOG_DBG("uart tx buffer full");
-				}
-				else if(buffer[j]->len <= (nus_loc + plen)){
-					// End of current NUS packet payload
-					nus_loc = 0;
-					uart_buf->len += plen;
-					k_free(buffer[j]);
-					if(!buffer[++j]){
-						break;
-					}
-					// j++;
-					LOG_DBG("end of NUS packet");
-					// break;
-					// continue;
-				}
-				else{
-					uart_buf->len += plen;
-					nus_loc += plen;					
-				}
-			}
-			if(buffer_full){
-				// send uart data, block if buisy
-				do{
-					// LOG_DBG("UART TX, len: %u", uart_loc);
-					err = uart_tx(uart, uart_buf->data, uart_buf->len, SYS_FOREVER_MS);
-					if ((err) && (err != -EBUSY)) {
-						LOG_DBG("UART TX err: %d", err);
-						break;
-					}
-					k_msleep(5);
-				}while(err == -EBUSY);				
-				// allocate new buffer, prev will be freed in cb.
-				do{
-					struct uart_data_t *uart_buf = k_malloc(uart_buf_size);
-					if(!uart_buf){
-						LOG_WRN("Could not allocate UART tx buffer!");
-						k_free(buffer[j]);
-						break;
-					}
-					memset(&uart_buf->data, 0, sizeof(uart_buf->data));
-					uart_buf->len = 0;
-
-				}while(!uart_buf);
-				
-				uart_buf->len = 0;
-				buffer_full = false;
-			}
-		}while(buffer[j]);
-
-		if(uart_buf->len){
-			// send partially filled UART TX buffer
-			// LOG_DBG("UART TX(partial), len: %u", uart_buf->len);
-			do{
-				err = uart_tx(uart, uart_buf->data, uart_buf->len, SYS_FOREVER_MS);
-				if (err) {
-					LOG_DBG("UART TX err: %d", err);		
-				}
-				k_msleep(5);
-			}while(err == -EBUSY);
-		}		
+	/* Each UART is serviced by its own thread, so a slow peripheral does
+	 * not hold up the other bridges.
+	 */
+	for (size_t i = 0; i < UART_BRIDGE_COUNT; i++) {
+		k_thread_create(&bridge_threads[i], bridge_stacks[i],
+				CONFIG_BRIDGE_UART_THREAD_STACK_SIZE, bridge_thread,
+				uart_bridge_get(i), NULL, NULL, PRIORITY, 0, K_NO_WAIT);
 	}
+
+	return 0;
 }
-K_THREAD_DEFINE(ble_read_thread_id, STACKSIZE, ble_read_thread, NULL, NULL,
-		NULL, PRIORITY, 0, 0);
\ No newline at end of file
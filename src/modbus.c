@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Modbus RTU framing helpers for the UART bridge
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include <zephyr/logging/log.h>
+
+#include "crc16_modbus.h"
+#include "modbus.h"
+
+LOG_MODULE_REGISTER(modbus, LOG_LEVEL_INF);
+
+#define MODBUS_FC_READ_COILS           0x01
+#define MODBUS_FC_READ_DISCRETE_INPUTS 0x02
+#define MODBUS_FC_READ_HOLDING_REGS    0x03
+#define MODBUS_FC_READ_INPUT_REGS      0x04
+#define MODBUS_FC_WRITE_COIL           0x05
+#define MODBUS_FC_WRITE_REG            0x06
+#define MODBUS_FC_READ_EXCEPT_STATUS   0x07
+#define MODBUS_FC_DIAGNOSTICS          0x08
+#define MODBUS_FC_GET_COMM_EVENT_CTR   0x0B
+#define MODBUS_FC_GET_COMM_EVENT_LOG   0x0C
+#define MODBUS_FC_WRITE_COILS          0x0F
+#define MODBUS_FC_WRITE_REGS           0x10
+#define MODBUS_FC_REPORT_SERVER_ID     0x11
+#define MODBUS_FC_READ_FILE_RECORD     0x14
+#define MODBUS_FC_WRITE_FILE_RECORD    0x15
+#define MODBUS_FC_MASK_WRITE_REG       0x16
+#define MODBUS_FC_READ_WRITE_REGS      0x17
+#define MODBUS_FC_READ_FIFO_QUEUE      0x18
+#define MODBUS_FC_EXCEPTION            0x80
+
+/* Unit ID, function code and CRC. */
+#define MODBUS_RTU_OVERHEAD (2 + MODBUS_RTU_CRC_LEN)
+
+static atomic_t next_tid;
+
+/* Predict the response length from the request, 0 if it depends on the
+ * response content only.
+ */
+static size_t req_rsp_len_predict(const uint8_t *adu, size_t len)
+{
+	uint16_t qty;
+
+	switch (adu[1]) {
+	case MODBUS_FC_READ_COILS:
+	case MODBUS_FC_READ_DISCRETE_INPUTS:
+		if (len < 6) {
+			return 0;
+		}
+		qty = sys_get_be16(&adu[4]);
+		return MODBUS_RTU_OVERHEAD + 1 + DIV_ROUND_UP(qty, 8);
+	case MODBUS_FC_READ_HOLDING_REGS:
+	case MODBUS_FC_READ_INPUT_REGS:
+	case MODBUS_FC_READ_WRITE_REGS:
+		if (len < 6) {
+			return 0;
+		}
+		qty = sys_get_be16(&adu[4]);
+		return MODBUS_RTU_OVERHEAD + 1 + 2 * qty;
+	case MODBUS_FC_DIAGNOSTICS:
+		/* Diagnostics responses echo the request. */
+		return len;
+	default:
+		return 0;
+	}
+}
+
+/* Return the full response length, 0 if more header bytes are needed or
+ * -EINVAL if the header cannot be framed.
+ */
+static int rsp_len_get(const struct modbus_rsp_parser *parser)
+{
+	const uint8_t *hdr = parser->hdr;
+	uint8_t fc;
+
+	if (parser->hdr_len < 2) {
+		return 0;
+	}
+
+	fc = hdr[1];
+
+	if (parser->req_valid &&
+	    ((hdr[0] != parser->req_unit) ||
+	     ((fc & ~MODBUS_FC_EXCEPTION) != parser->req_fc))) {
+		LOG_DBG("Response 0x%02X/0x%02X does not match request 0x%02X/0x%02X",
+			hdr[0], fc, parser->req_unit, parser->req_fc);
+		return -EINVAL;
+	}
+
+	if (fc & MODBUS_FC_EXCEPTION) {
+		return MODBUS_RTU_OVERHEAD + 1;
+	}
+
+	switch (fc) {
+	case MODBUS_FC_READ_EXCEPT_STATUS:
+		return MODBUS_RTU_OVERHEAD + 1;
+	case MODBUS_FC_WRITE_COIL:
+	case MODBUS_FC_WRITE_REG:
+	case MODBUS_FC_GET_COMM_EVENT_CTR:
+	case MODBUS_FC_WRITE_COILS:
+	case MODBUS_FC_WRITE_REGS:
+		return MODBUS_RTU_OVERHEAD + 4;
+	case MODBUS_FC_MASK_WRITE_REG:
+		return MODBUS_RTU_OVERHEAD + 6;
+	case MODBUS_FC_DIAGNOSTICS:
+		return parser->req_rsp_len ? parser->req_rsp_len : MODBUS_RTU_OVERHEAD + 4;
+	case MODBUS_FC_READ_COILS:
+	case MODBUS_FC_READ_DISCRETE_INPUTS:
+	case MODBUS_FC_READ_HOLDING_REGS:
+	case MODBUS_FC_READ_INPUT_REGS:
+	case MODBUS_FC_GET_COMM_EVENT_LOG:
+	case MODBUS_FC_REPORT_SERVER_ID:
+	case MODBUS_FC_READ_FILE_RECORD:
+	case MODBUS_FC_WRITE_FILE_RECORD:
+	case MODBUS_FC_READ_WRITE_REGS:
+		/* The byte count is authoritative, use the prediction until
+		 * it arrives.
+		 */
+		if (parser->hdr_len < 3) {
+			return parser->req_rsp_len;
+		}
+		return MODBUS_RTU_OVERHEAD + 1 + hdr[2];
+	case MODBUS_FC_READ_FIFO_QUEUE:
+		if (parser->hdr_len < 4) {
+			return 0;
+		}
+		return MODBUS_RTU_OVERHEAD + 2 + sys_get_be16(&hdr[2]);
+	default:
+		LOG_DBG("Cannot frame function code 0x%02X", fc);
+		return -EINVAL;
+	}
+}
+
+/* Find the request with the given transaction ID, NULL if it is not
+ * waiting for a response. Called with the table lock held.
+ */
+static struct modbus_req *req_find(struct modbus_req_table *table, uint8_t tid)
+{
+	for (size_t i = 0; i < MODBUS_REQ_SLOTS; i++) {
+		if (table->req[i].valid && (table->req[i].tid == tid)) {
+			return &table->req[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Find a free slot, or the slot of the oldest request when all slots are
+ * taken. Called with the table lock held.
+ */
+static struct modbus_req *req_slot_get(struct modbus_req_table *table)
+{
+	struct modbus_req *oldest = &table->req[0];
+
+	for (size_t i = 0; i < MODBUS_REQ_SLOTS; i++) {
+		struct modbus_req *req = &table->req[i];
+
+		if (!req->valid) {
+			return req;
+		}
+
+		if ((int32_t)(req->seq - oldest->seq) < 0) {
+			oldest = req;
+		}
+	}
+
+	return oldest;
+}
+
+/* Record a request, returns the transaction ID it is tracked under. The
+ * slot of the oldest request is reused when all slots are taken.
+ */
+static uint8_t req_store(struct modbus_req_table *table, const uint8_t *adu, size_t len)
+{
+	struct modbus_req *req;
+	k_spinlock_key_t key;
+	uint8_t tid;
+
+	key = k_spin_lock(&table->lock);
+	/* Skip the IDs still held by requests of the table after a wrap. */
+	do {
+		tid = (uint8_t)atomic_inc(&next_tid);
+	} while ((MODBUS_REQ_SLOTS > 1) && req_find(table, tid));
+
+	if (adu[0] != MODBUS_UNIT_BROADCAST) {
+		req = req_slot_get(table);
+		if (req->valid && (MODBUS_REQ_SLOTS > 1)) {
+			LOG_WRN("Request %u not answered, dropped", req->tid);
+		}
+
+		req->valid = true;
+		req->tid = tid;
+		req->unit = adu[0];
+		req->fc = adu[1];
+		req->rsp_len = req_rsp_len_predict(adu, len);
+		req->seq = table->seq++;
+	}
+	k_spin_unlock(&table->lock, key);
+
+	return tid;
+}
+
+/* Hand the request with the given transaction ID over to the parser. Each
+ * request is answered once.
+ */
+static void req_take(struct modbus_rsp_parser *parser, uint8_t tid)
+{
+	struct modbus_req_table *table = parser->table;
+	struct modbus_req *req;
+	k_spinlock_key_t key;
+
+	if (!table) {
+		return;
+	}
+
+	key = k_spin_lock(&table->lock);
+	if (MODBUS_REQ_SLOTS == 1) {
+		/* Requests are answered in order, take the outstanding one. */
+		tid = table->req[0].tid;
+	}
+
+	req = req_find(table, tid);
+	if (req) {
+		parser->req_valid = true;
+		parser->req_unit = req->unit;
+		parser->req_fc = req->fc;
+		parser->req_rsp_len = req->rsp_len;
+		req->valid = false;
+	}
+	k_spin_unlock(&table->lock, key);
+}
+
+bool modbus_req_pending(struct modbus_req_table *table, uint8_t tid)
+{
+	k_spinlock_key_t key;
+	bool pending;
+
+	key = k_spin_lock(&table->lock);
+	pending = (req_find(table, tid) != NULL);
+	k_spin_unlock(&table->lock, key);
+
+	return pending;
+}
+
+void modbus_req_track(struct modbus_req_table *table, const uint8_t *adu, size_t len)
+{
+	if (len < MODBUS_RTU_OVERHEAD) {
+		return;
+	}
+
+	(void)req_store(table, adu, len);
+}
+
+int modbus_rtu_to_compact(struct modbus_req_table *table, uint8_t *buf, size_t len,
+			  uint16_t residue)
+{
+	size_t adu_len;
+
+	if (len < MODBUS_RTU_OVERHEAD) {
+		return -EINVAL;
+	}
+
+	adu_len = len - MODBUS_RTU_CRC_LEN;
+	if (residue != 0) {
+		return -EBADMSG;
+	}
+
+	memmove(&buf[MODBUS_COMPACT_HDR_LEN], buf, adu_len);
+	buf[0] = req_store(table, &buf[MODBUS_COMPACT_HDR_LEN], len);
+
+	return adu_len + MODBUS_COMPACT_HDR_LEN;
+}
+
+int modbus_compact_to_rtu(uint8_t *buf, size_t len, size_t size)
+{
+	size_t adu_len;
+
+	if (len < (MODBUS_COMPACT_HDR_LEN + 2)) {
+		return -EINVAL;
+	}
+
+	adu_len = len - MODBUS_COMPACT_HDR_LEN;
+	if ((adu_len + MODBUS_RTU_CRC_LEN) > size) {
+		return -ENOMEM;
+	}
+
+	memmove(buf, &buf[MODBUS_COMPACT_HDR_LEN], adu_len);
+	sys_put_le16(crc16_modbus(buf, adu_len), &buf[adu_len]);
+
+	return adu_len + MODBUS_RTU_CRC_LEN;
+}
+
+void modbus_rsp_parser_init(struct modbus_rsp_parser *parser, struct modbus_req_table *table)
+{
+	memset(parser, 0, sizeof(*parser));
+	parser->table = table;
+	parser->status = MODBUS_RSP_INCOMPLETE;
+
+	if (!IS_ENABLED(CONFIG_BRIDGE_COMPACT_FRAMING)) {
+		req_take(parser, 0);
+	}
+}
+
+enum modbus_rsp_status modbus_rsp_parser_feed(struct modbus_rsp_parser *parser,
+					      const uint8_t *data, size_t len,
+					      size_t *used)
+{
+	size_t hdr_offset = 0;
+	size_t frame_len;
+	int rsp_len;
+
+	*used = 0;
+
+	if ((parser->status != MODBUS_RSP_INCOMPLETE) || (len == 0)) {
+		return parser->status;
+	}
+
+	if (IS_ENABLED(CONFIG_BRIDGE_COMPACT_FRAMING) && !parser->tid_valid) {
+		parser->tid = data[0];
+		parser->tid_valid = true;
+		hdr_offset = MODBUS_COMPACT_HDR_LEN;
+
+		req_take(parser, parser->tid);
+		if (!parser->req_valid) {
+			LOG_DBG("No request with transaction ID %u", parser->tid);
+		}
+	}
+
+	for (size_t i = hdr_offset; (i < len) && (parser->hdr_len < sizeof(parser->hdr)); i++) {
+		parser->hdr[parser->hdr_len++] = data[i];
+	}
+
+	rsp_len = rsp_len_get(parser);
+	if ((rsp_len < 0) || (rsp_len > MODBUS_RTU_ADU_MAX)) {
+		parser->status = MODBUS_RSP_MALFORMED;
+	}
+
+	if ((rsp_len <= 0) || (parser->status == MODBUS_RSP_MALFORMED)) {
+		parser->rx_len += len;
+		*used = len;
+		return parser->status;
+	}
+
+	/* The compact frame carries the transaction ID instead of the CRC. */
+	frame_len = IS_ENABLED(CONFIG_BRIDGE_COMPACT_FRAMING) ?
+		    rsp_len - MODBUS_RTU_CRC_LEN + MODBUS_COMPACT_HDR_LEN : rsp_len;
+	parser->expected = frame_len;
+
+	*used = MIN(len, frame_len - MIN(parser->rx_len, frame_len));
+	parser->rx_len += *used;
+	if (parser->rx_len >= frame_len) {
+		parser->status = MODBUS_RSP_COMPLETE;
+	}
+
+	return parser->status;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_H_
+#define MODBUS_H_
+
+/** @file
+ *  @brief Modbus RTU framing helpers for the UART bridge
+ *
+ *  Two framings are supported on the Bluetooth link. With RTU framing the
+ *  ADUs are forwarded as received on the UART. With compact framing, the
+ *  RTU CRC is validated and stripped at the UART edge and each ADU is
+ *  prefixed with a one byte transaction ID:
+ *
+ *  | Transaction ID | Unit ID | PDU |
+ *
+ *  The length of the frame is given by the PDU itself, so no length field
+ *  is needed. The transaction ID lets the peripheral answer several
+ *  pipelined requests, and the CRC is regenerated before the response is
+ *  sent out on the UART.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum size of a Modbus RTU ADU, unit ID and CRC included. */
+#define MODBUS_RTU_ADU_MAX 256
+
+/** Size of the Modbus RTU CRC trailer. */
+#define MODBUS_RTU_CRC_LEN 2
+
+/** Size of the compact frame header preceding the unit ID. */
+#define MODBUS_COMPACT_HDR_LEN 1
+
+/** Unit ID used for broadcast requests. */
+#define MODBUS_UNIT_BROADCAST 0
+
+/** Number of response header bytes needed to determine the frame length. */
+#define MODBUS_RSP_HDR_LEN 4
+
+#if defined(CONFIG_BRIDGE_COMPACT_FRAMING)
+#define MODBUS_REQ_SLOTS CONFIG_BRIDGE_COMPACT_MAX_INFLIGHT
+#else
+#define MODBUS_REQ_SLOTS 1
+#endif
+
+/** @brief Request waiting for a response. */
+struct modbus_req {
+	bool valid;
+	uint8_t tid;
+	uint8_t unit;
+	uint8_t fc;
+	size_t rsp_len;
+	/* Order in which the requests were sent. */
+	uint32_t seq;
+};
+
+/** @brief Requests sent on behalf of one Modbus master.
+ *
+ *  Each UART tracks its requests in its own table, so that the responses
+ *  are framed against the requests of the master they are sent to.
+ *  Transaction IDs are given out from a counter shared by the tables, so
+ *  that a response identifies the master it is sent to, and the requests
+ *  are looked up by ID. Its fields are private.
+ */
+struct modbus_req_table {
+	struct k_spinlock lock;
+	struct modbus_req req[MODBUS_REQ_SLOTS];
+	uint32_t seq;
+};
+
+/** @brief Response parser status. */
+enum modbus_rsp_status {
+	/** More bytes are needed to complete the frame. */
+	MODBUS_RSP_INCOMPLETE,
+	/** All bytes of the frame have been received. */
+	MODBUS_RSP_COMPLETE,
+	/** The data cannot be framed as a Modbus RTU response. */
+	MODBUS_RSP_MALFORMED,
+};
+
+/** @brief Modbus RTU response parser.
+ *
+ *  The parser is fed with the response bytes in the order they arrive and
+ *  reports when the frame is complete. Its fields are private.
+ */
+struct modbus_rsp_parser {
+	struct modbus_req_table *table;
+	uint8_t hdr[MODBUS_RSP_HDR_LEN];
+	uint8_t hdr_len;
+	uint8_t tid;
+	bool tid_valid;
+	uint8_t req_unit;
+	uint8_t req_fc;
+	bool req_valid;
+	size_t req_rsp_len;
+	size_t rx_len;
+	size_t expected;
+	enum modbus_rsp_status status;
+};
+
+/** @brief Track a request sent to the peripheral with RTU framing.
+ *
+ *  The request is used to predict the length of the next response and to
+ *  validate its header. Broadcast requests are not tracked since they are
+ *  not answered.
+ *
+ *  @param table Request table of the master.
+ *  @param adu Modbus RTU request, unit ID and CRC included.
+ *  @param len Length of the request.
+ */
+void modbus_req_track(struct modbus_req_table *table, const uint8_t *adu, size_t len);
+
+/** @brief Check if a request is waiting for its response.
+ *
+ *  Used with compact framing to find the master a response is sent to.
+ *
+ *  @param table Request table of a master.
+ *  @param tid Transaction ID of the response.
+ *
+ *  @return true if the request with the transaction ID is in the table.
+ */
+bool modbus_req_pending(struct modbus_req_table *table, uint8_t tid);
+
+/** @brief Convert a request from RTU to compact framing in place.
+ *
+ *  The CRC is validated and removed, and the request is tracked under a
+ *  new transaction ID.
+ *
+ *  @param table Request table of the master.
+ *  @param buf Buffer holding the Modbus RTU request.
+ *  @param len Length of the request.
+ *  @param residue CRC calculated over the whole request, CRC included, as
+ *                 the request was received. Zero for a valid request.
+ *
+ *  @retval Length of the compact frame.
+ *  @retval -EINVAL The request is too short.
+ *  @retval -EBADMSG The CRC does not match.
+ */
+int modbus_rtu_to_compact(struct modbus_req_table *table, uint8_t *buf, size_t len,
+			  uint16_t residue);
+
+/** @brief Convert a response from compact to RTU framing in place.
+ *
+ *  The transaction ID is removed and the CRC is appended.
+ *
+ *  @param buf Buffer holding the compact frame.
+ *  @param len Length of the compact frame.
+ *  @param size Size of the buffer.
+ *
+ *  @retval Length of the Modbus RTU response.
+ *  @retval -EINVAL The frame is too short.
+ *  @retval -ENOMEM The buffer cannot hold the CRC.
+ */
+int modbus_compact_to_rtu(uint8_t *buf, size_t len, size_t size);
+
+/** @brief Prepare a parser for the next response.
+ *
+ *  With RTU framing, takes over the outstanding request recorded by
+ *  @ref modbus_req_track. With compact framing, the request is looked up
+ *  when the transaction ID is received.
+ *
+ *  @param parser Parser instance.
+ *  @param table Request table of the master the response is sent to, or
+ *               NULL to frame the response from its header only.
+ */
+void modbus_rsp_parser_init(struct modbus_rsp_parser *parser, struct modbus_req_table *table);
+
+/** @brief Feed response bytes to the parser.
+ *
+ *  @param parser Parser instance.
+ *  @param data Received bytes.
+ *  @param len Number of received bytes.
+ *  @param used Number of bytes belonging to the frame. Less than @p len
+ *              when the frame completes before the end of the data.
+ *
+ *  @return Parser status after consuming the bytes.
+ */
+enum modbus_rsp_status modbus_rsp_parser_feed(struct modbus_rsp_parser *parser,
+					      const uint8_t *data, size_t len,
+					      size_t *used);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MODBUS_H_ */
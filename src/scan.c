@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief Scanning for NUS peripherals
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include <bluetooth/services/nus.h>
+#include <bluetooth/scan.h>
+
+#include <zephyr/logging/log.h>
+
+#include "scan.h"
+
+LOG_MODULE_REGISTER(scan, LOG_LEVEL_INF);
+
+#define KNOWN_PEERS_MAX CONFIG_BT_SCAN_ADDRESS_CNT
+
+enum scan_profile {
+	SCAN_PROFILE_NONE,
+	SCAN_PROFILE_BURST,
+	SCAN_PROFILE_RELAXED,
+};
+
+static struct bt_le_scan_param burst_param = {
+	.type = BT_LE_SCAN_TYPE_ACTIVE,
+	.options = BT_LE_SCAN_OPT_FILTER_DUPLICATE,
+	.interval = CONFIG_BRIDGE_SCAN_BURST_INTERVAL,
+	.window = CONFIG_BRIDGE_SCAN_BURST_WINDOW,
+};
+
+static struct bt_le_scan_param relaxed_param = {
+	.type = BT_LE_SCAN_TYPE_ACTIVE,
+	.options = BT_LE_SCAN_OPT_FILTER_DUPLICATE,
+	.interval = CONFIG_BRIDGE_SCAN_RELAXED_INTERVAL,
+	.window = CONFIG_BRIDGE_SCAN_RELAXED_WINDOW,
+};
+
+static enum scan_profile profile;
+static struct k_work_delayable backoff_work;
+static atomic_t conn_count;
+
+static bt_addr_le_t known_peers[KNOWN_PEERS_MAX];
+static size_t known_peer_cnt;
+static size_t known_peer_next;
+
+static bool known_peer_add(const bt_addr_le_t *addr)
+{
+	for (size_t i = 0; i < known_peer_cnt; i++) {
+		if (bt_addr_le_eq(&known_peers[i], addr)) {
+			return false;
+		}
+	}
+
+	/* Replace the oldest entry when the list is full. */
+	bt_addr_le_copy(&known_peers[known_peer_next], addr);
+	known_peer_next = (known_peer_next + 1) % KNOWN_PEERS_MAX;
+	known_peer_cnt = MIN(known_peer_cnt + 1, KNOWN_PEERS_MAX);
+
+	return true;
+}
+
+static void bond_found(const struct bt_bond_info *info, void *user_data)
+{
+	ARG_UNUSED(user_data);
+
+	(void)known_peer_add(&info->addr);
+}
+
+static bool known_peers_exist(void)
+{
+	return (known_peer_cnt > 0) || (strlen(CONFIG_BRIDGE_SCAN_PEER_NAME) > 0);
+}
+
+static int filters_apply(void)
+{
+	uint8_t mask = BT_SCAN_UUID_FILTER;
+	int err;
+
+	bt_scan_filter_remove_all();
+
+	err = bt_scan_filter_add(BT_SCAN_FILTER_TYPE_UUID, BT_UUID_NUS_SERVICE);
+	if (err) {
+		LOG_ERR("Scanning filters cannot be set (err %d)", err);
+		return err;
+	}
+
+	if (strlen(CONFIG_BRIDGE_SCAN_PEER_NAME) > 0) {
+		err = bt_scan_filter_add(BT_SCAN_FILTER_TYPE_NAME,
+					 CONFIG_BRIDGE_SCAN_PEER_NAME);
+		if (err) {
+			LOG_ERR("Name filter cannot be set (err %d)", err);
+			return err;
+		}
+		mask |= BT_SCAN_NAME_FILTER;
+	}
+
+	for (size_t i = 0; i < known_peer_cnt; i++) {
+		err = bt_scan_filter_add(BT_SCAN_FILTER_TYPE_ADDR, &known_peers[i]);
+		if (err) {
+			LOG_ERR("Address filter cannot be set (err %d)", err);
+			return err;
+		}
+		mask |= BT_SCAN_ADDR_FILTER;
+	}
+
+	/* Any of the filters is enough for a match. */
+	err = bt_scan_filter_enable(mask, false);
+	if (err) {
+		LOG_ERR("Filters cannot be turned on (err %d)", err);
+	}
+
+	return err;
+}
+
+static void scan_stop(void)
+{
+	int err;
+
+	k_work_cancel_delayable(&backoff_work);
+	profile = SCAN_PROFILE_NONE;
+
+	err = bt_scan_stop();
+	if (err && (err != -EALREADY)) {
+		LOG_ERR("Stop LE scan failed (err %d)", err);
+	}
+}
+
+static int scan_profile_start(enum scan_profile new_profile)
+{
+	struct bt_le_scan_param *param;
+	enum bt_scan_type type;
+	int err;
+
+	scan_stop();
+
+	if (atomic_get(&conn_count) >= CONFIG_BT_MAX_CONN) {
+		/* No connection left for a new peripheral. */
+		return 0;
+	}
+
+	err = filters_apply();
+	if (err) {
+		return err;
+	}
+
+	if (new_profile == SCAN_PROFILE_BURST) {
+		param = &burst_param;
+		/* Known peers are matched on their advertising data, scan
+		 * requests would only slow the burst down.
+		 */
+		type = (IS_ENABLED(CONFIG_BRIDGE_SCAN_PASSIVE_KNOWN_PEERS) &&
+			known_peers_exist()) ?
+		       BT_SCAN_TYPE_SCAN_PASSIVE : BT_SCAN_TYPE_SCAN_ACTIVE;
+	} else {
+		param = &relaxed_param;
+		type = BT_SCAN_TYPE_SCAN_ACTIVE;
+	}
+
+	bt_scan_params_set(param);
+
+	err = bt_scan_start(type);
+	if (err) {
+		LOG_ERR("Scanning failed to start (err %d)", err);
+		return err;
+	}
+
+	profile = new_profile;
+	if (profile == SCAN_PROFILE_BURST) {
+		k_work_reschedule(&backoff_work, K_MSEC(CONFIG_BRIDGE_SCAN_BURST_DURATION_MS));
+	}
+
+	LOG_INF("Scanning started, %s %s profile",
+		(type == BT_SCAN_TYPE_SCAN_PASSIVE) ? "passive" : "active",
+		(profile == SCAN_PROFILE_BURST) ? "burst" : "relaxed");
+
+	return 0;
+}
+
+static void backoff_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	if (profile == SCAN_PROFILE_BURST) {
+		(void)scan_profile_start(SCAN_PROFILE_RELAXED);
+	}
+}
+
+static void scan_filter_match(struct bt_scan_device_info *device_info,
+			      struct bt_scan_filter_match *filter_match,
+			      bool connectable)
+{
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	bt_addr_le_to_str(device_info->recv_info->addr, addr, sizeof(addr));
+
+	LOG_INF("Filters matched. Address: %s connectable: %d",
+		addr, connectable);
+}
+
+static void scan_connecting_error(struct bt_scan_device_info *device_info)
+{
+	LOG_WRN("Connecting failed");
+
+	(void)scan_profile_start(SCAN_PROFILE_BURST);
+}
+
+BT_SCAN_CB_INIT(scan_cb, scan_filter_match, NULL,
+		scan_connecting_error, NULL);
+
+static void connected(struct bt_conn *conn, uint8_t conn_err)
+{
+	if (conn_err) {
+		(void)scan_profile_start(SCAN_PROFILE_BURST);
+		return;
+	}
+
+	atomic_inc(&conn_count);
+	(void)known_peer_add(bt_conn_get_dst(conn));
+
+	if (IS_ENABLED(CONFIG_BRIDGE_SCAN_WHILE_CONNECTED)) {
+		/* Keep looking for more peripherals without taking radio time
+		 * from the established connections.
+		 */
+		(void)scan_profile_start(SCAN_PROFILE_RELAXED);
+	} else {
+		scan_stop();
+	}
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	atomic_dec(&conn_count);
+
+	(void)scan_profile_start(SCAN_PROFILE_BURST);
+}
+
+BT_CONN_CB_DEFINE(scan_conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
+
+int scan_init(void)
+{
+	struct bt_scan_init_param scan_init = {
+		.scan_param = &burst_param,
+		.connect_if_match = 1,
+	};
+
+	k_work_init_delayable(&backoff_work, backoff_work_handler);
+
+	bt_scan_init(&scan_init);
+	bt_scan_cb_register(&scan_cb);
+
+	bt_foreach_bond(BT_ID_DEFAULT, bond_found, NULL);
+	LOG_INF("Scan module initialized, %zu known peers", known_peer_cnt);
+
+	return filters_apply();
+}
+
+int scan_start(void)
+{
+	return scan_profile_start(SCAN_PROFILE_BURST);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef SCAN_H_
+#define SCAN_H_
+
+/** @file
+ *  @brief Scanning for NUS peripherals
+ *
+ *  Scanning uses two profiles. The burst profile scans with a 100% duty
+ *  cycle to acquire a peripheral quickly after boot, a disconnection or a
+ *  failed connection attempt. After a while it backs off to the relaxed
+ *  profile, which uses little radio time and may keep running while
+ *  connected so that additional peripherals can be acquired.
+ *
+ *  Known peers, that is bonded or previously connected peripherals and
+ *  peripherals with the configured name, are matched on their advertising
+ *  data. This allows the burst profile to scan passively when there are
+ *  known peers. New peripherals are matched on the NUS UUID in their scan
+ *  response with the relaxed profile.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Initialize the scan module.
+ *
+ *  Must be called after the bonding information has been loaded.
+ *
+ *  @return 0 on success, negative error code otherwise.
+ */
+int scan_init(void);
+
+/** @brief Start scanning with the burst profile.
+ *
+ *  @return 0 on success, negative error code otherwise.
+ */
+int scan_start(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCAN_H_ */
@@ -0,0 +1,546 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** @file
+ *  @brief UART bridge instances
+ */
+
+#include <uart_async_adapter.h>
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/util.h>
+
+#include <zephyr/logging/log.h>
+
+#include "uart_bridge.h"
+
+LOG_MODULE_REGISTER(uart_bridge, LOG_LEVEL_DBG);
+
+#define PRIORITY 7
+
+#define UART_WAIT_FOR_BUF_DELAY K_MSEC(50)
+#define UART_RX_TIMEOUT 50000 /* Wait for RX complete event time in microseconds. */
+#define DTR_POLL_INTERVAL K_MSEC(100)
+
+#define DT_DRV_COMPAT nordic_nus_uart_bridge
+
+struct nus_data_t {
+	void *fifo_reserved;
+	/* Source of the data, passed back at the end of a response. */
+	void *user_data;
+	uint16_t len;
+	uint8_t data[];
+};
+
+#ifdef CONFIG_UART_ASYNC_ADAPTER
+#define UART_BRIDGE_ADAPTER_DEFINE(name) UART_ASYNC_ADAPTER_INST_DEFINE(name);
+#define UART_BRIDGE_ADAPTER_SET(idx, name) (bridges[idx].async_adapter = name)
+#else
+#define UART_BRIDGE_ADAPTER_DEFINE(name)
+#define UART_BRIDGE_ADAPTER_SET(idx, name)
+#endif
+
+#if DT_HAS_COMPAT_STATUS_OKAY(nordic_nus_uart_bridge)
+#define UART_BRIDGE_RESOURCES_DEFINE(inst)						\
+	K_HEAP_DEFINE(uart_bridge_heap_##inst, CONFIG_BRIDGE_UART_HEAP_SIZE);		\
+	UART_BRIDGE_ADAPTER_DEFINE(uart_bridge_adapter_##inst)				\
+	COND_CODE_1(DT_INST_NODE_HAS_PROP(inst, unit_ids),				\
+		    (static const uint8_t uart_bridge_units_##inst[] =			\
+			     DT_INST_PROP(inst, unit_ids);),				\
+		    ())
+
+#define UART_BRIDGE_INIT(inst)								\
+	[inst] = {									\
+		.uart = DEVICE_DT_GET(DT_INST_PHANDLE(inst, uart)),			\
+		.peer_name = DT_INST_PROP_OR(inst, peer_name, NULL),			\
+		.unit_ids = COND_CODE_1(DT_INST_NODE_HAS_PROP(inst, unit_ids),		\
+					(uart_bridge_units_##inst), (NULL)),		\
+		.unit_id_cnt = DT_INST_PROP_LEN_OR(inst, unit_ids, 0),			\
+		.heap = &uart_bridge_heap_##inst,					\
+	},
+
+#define UART_BRIDGE_ADAPTERS_SET(inst)							\
+	UART_BRIDGE_ADAPTER_SET(inst, uart_bridge_adapter_##inst);
+
+DT_INST_FOREACH_STATUS_OKAY(UART_BRIDGE_RESOURCES_DEFINE)
+
+static struct uart_bridge bridges[] = {
+	DT_INST_FOREACH_STATUS_OKAY(UART_BRIDGE_INIT)
+};
+
+static void adapters_set(void)
+{
+	DT_INST_FOREACH_STATUS_OKAY(UART_BRIDGE_ADAPTERS_SET)
+}
+#else
+K_HEAP_DEFINE(uart_bridge_heap, CONFIG_BRIDGE_UART_HEAP_SIZE);
+UART_BRIDGE_ADAPTER_DEFINE(uart_bridge_adapter)
+
+static struct uart_bridge bridges[] = {
+	{
+		.uart = DEVICE_DT_GET(DT_CHOSEN(nordic_nus_uart)),
+		.heap = &uart_bridge_heap,
+	},
+};
+
+static void adapters_set(void)
+{
+	UART_BRIDGE_ADAPTER_SET(0, uart_bridge_adapter);
+}
+#endif
+
+BUILD_ASSERT(ARRAY_SIZE(bridges) == UART_BRIDGE_COUNT);
+
+static K_THREAD_STACK_ARRAY_DEFINE(tx_thread_stacks, UART_BRIDGE_COUNT,
+				   CONFIG_BRIDGE_UART_THREAD_STACK_SIZE);
+
+static uart_bridge_rsp_done_cb_t rsp_done_cb;
+
+static struct uart_data_t *uart_buf_alloc(struct uart_bridge *bridge)
+{
+	struct uart_data_t *buf = k_heap_alloc(bridge->heap, sizeof(*buf), K_NO_WAIT);
+
+	if (buf) {
+		buf->len = 0;
+		crc16_modbus_init(&buf->crc);
+	}
+
+	return buf;
+}
+
+static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+	struct uart_bridge *bridge = user_data;
+	struct uart_data_t *buf;
+
+	ARG_UNUSED(dev);
+
+	switch (evt->type) {
+	case UART_TX_DONE:
+		LOG_DBG("UART_TX_DONE");
+		if ((evt->data.tx.len == 0) ||
+		    (!evt->data.tx.buf)) {
+			return;
+		}
+
+		if (bridge->aborted_buf) {
+			buf = CONTAINER_OF(bridge->aborted_buf, struct uart_data_t,
+					   data[0]);
+			bridge->aborted_buf = NULL;
+			bridge->aborted_len = 0;
+		} else {
+			buf = CONTAINER_OF(evt->data.tx.buf,
+					   struct uart_data_t,
+					   data[0]);
+		}
+
+		k_heap_free(bridge->heap, buf);
+		break;
+
+	case UART_RX_RDY:
+		LOG_DBG("UART_RX_RDY");
+		buf = CONTAINER_OF(evt->data.rx.buf, struct uart_data_t, data[0]);
+		buf->len += evt->data.rx.len;
+		if (IS_ENABLED(CONFIG_BRIDGE_COMPACT_FRAMING)) {
+			crc16_modbus_update(&buf->crc, &evt->data.rx.buf[evt->data.rx.offset],
+					    evt->data.rx.len);
+		}
+		LOG_DBG("UART_RX_RDY, len: %d", evt->data.rx.len);
+
+		if (bridge->disable_req) {
+			return;
+		}
+
+		bridge->disable_req = true;
+		uart_rx_disable(bridge->uart);
+
+		break;
+
+	case UART_RX_DISABLED:
+		LOG_DBG("UART_RX_DISABLED");
+		bridge->disable_req = false;
+
+		buf = uart_buf_alloc(bridge);
+		if (!buf) {
+			LOG_WRN("Not able to allocate UART receive buffer");
+			k_work_reschedule(&bridge->rx_work, UART_WAIT_FOR_BUF_DELAY);
+			return;
+		}
+
+		uart_rx_enable(bridge->uart, buf->data, sizeof(buf->data),
+			       UART_RX_TIMEOUT);
+
+		break;
+
+	case UART_RX_BUF_REQUEST:
+		LOG_DBG("UART_RX_BUF_REQUEST");
+		buf = uart_buf_alloc(bridge);
+		if (buf) {
+			uart_rx_buf_rsp(bridge->uart, buf->data, sizeof(buf->data));
+		} else {
+			LOG_WRN("Not able to allocate UART receive buffer");
+		}
+
+		break;
+
+	case UART_RX_BUF_RELEASED:
+		buf = CONTAINER_OF(evt->data.rx_buf.buf, struct uart_data_t,
+				   data[0]);
+		LOG_DBG("UART_RX_BUF_RELEASED, len: %d", buf->len);
+
+		if (buf->len > 0) {
+			k_fifo_put(&bridge->rx_fifo, buf);
+		} else {
+			k_heap_free(bridge->heap, buf);
+		}
+
+		break;
+
+	case UART_TX_ABORTED:
+		LOG_DBG("UART_TX_ABORTED");
+		if (!bridge->aborted_buf) {
+			bridge->aborted_buf = (uint8_t *)evt->data.tx.buf;
+		}
+
+		bridge->aborted_len += evt->data.tx.len;
+		buf = CONTAINER_OF((void *)bridge->aborted_buf, struct uart_data_t,
+				   data);
+		uart_tx(bridge->uart, &buf->data[bridge->aborted_len],
+			buf->len - bridge->aborted_len, SYS_FOREVER_MS);
+
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void rx_work_handler(struct k_work *item)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(item);
+	struct uart_bridge *bridge = CONTAINER_OF(dwork, struct uart_bridge, rx_work);
+	struct uart_data_t *buf;
+
+	buf = uart_buf_alloc(bridge);
+	if (!buf) {
+		LOG_WRN("Not able to allocate UART receive buffer(work handler)");
+		k_work_reschedule(&bridge->rx_work, UART_WAIT_FOR_BUF_DELAY);
+		return;
+	}
+
+	uart_rx_enable(bridge->uart, buf->data, sizeof(buf->data), UART_RX_TIMEOUT);
+}
+
+static bool uart_test_async_api(const struct device *dev)
+{
+	const struct uart_driver_api *api =
+			(const struct uart_driver_api *)dev->api;
+
+	return (api->callback_set != NULL);
+}
+
+static void dtr_work_handler(struct k_work *item)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(item);
+	struct uart_bridge *bridge = CONTAINER_OF(dwork, struct uart_bridge, dtr_work);
+	uint32_t dtr = 0;
+	int err;
+
+	uart_line_ctrl_get(bridge->uart, UART_LINE_CTRL_DTR, &dtr);
+	if (!dtr) {
+		k_work_reschedule(&bridge->dtr_work, DTR_POLL_INTERVAL);
+		return;
+	}
+
+	LOG_INF("%s: DTR set", bridge->uart->name);
+	err = uart_line_ctrl_set(bridge->uart, UART_LINE_CTRL_DCD, 1);
+	if (err) {
+		LOG_WRN("Failed to set DCD, ret code %d", err);
+	}
+	err = uart_line_ctrl_set(bridge->uart, UART_LINE_CTRL_DSR, 1);
+	if (err) {
+		LOG_WRN("Failed to set DSR, ret code %d", err);
+	}
+
+	bridge->ready_time = k_uptime_get();
+	k_work_reschedule(&bridge->rx_work, K_NO_WAIT);
+}
+
+static int uart_tx_frame(struct uart_bridge *bridge, struct uart_data_t *buf)
+{
+	int err;
+
+	/* Send UART data, block while the previous transfer is ongoing. The
+	 * buffer is freed in the callback once transmitted.
+	 */
+	do {
+		err = uart_tx(bridge->uart, buf->data, buf->len, SYS_FOREVER_MS);
+		if (err == -EBUSY) {
+			k_msleep(5);
+		}
+	} while (err == -EBUSY);
+
+	if (err) {
+		LOG_WRN("UART TX err: %d", err);
+		k_heap_free(bridge->heap, buf);
+	}
+
+	return err;
+}
+
+static void rsp_flush(struct uart_bridge *bridge, struct uart_data_t *tx,
+		      enum modbus_rsp_status status)
+{
+	int err;
+
+	if (IS_ENABLED(CONFIG_BRIDGE_COMPACT_FRAMING)) {
+		/* Without a complete frame the CRC cannot be regenerated. */
+		err = (status == MODBUS_RSP_COMPLETE) ?
+		      modbus_compact_to_rtu(tx->data, tx->len, sizeof(tx->data)) :
+		      -EBADMSG;
+		if (err < 0) {
+			LOG_WRN("Dropping response frame (err %d)", err);
+			k_heap_free(bridge->heap, tx);
+			return;
+		}
+		tx->len = err;
+	}
+
+	if (tx->len) {
+		uart_tx_frame(bridge, tx);
+	} else {
+		k_heap_free(bridge->heap, tx);
+	}
+}
+
+static void tx_thread(void *p1, void *p2, void *p3)
+{
+	struct uart_bridge *bridge = p1;
+	struct modbus_rsp_parser parser;
+	enum modbus_rsp_status status;
+	struct nus_data_t *rx = NULL;
+	uint16_t loc = 0;
+	void *user_data;
+
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	for (;;) {
+		if (!rx) {
+			/* Wait indefinitely for data to be sent over UART */
+			rx = k_fifo_get(&bridge->tx_fifo, K_FOREVER);
+			loc = 0;
+		}
+
+		struct uart_data_t *tx = uart_buf_alloc(bridge);
+
+		if (!tx) {
+			LOG_WRN("Could not allocate UART tx buffer!");
+			k_heap_free(bridge->heap, rx);
+			rx = NULL;
+			continue;
+		}
+
+		/* The response is attributed to the source of its first byte. */
+		user_data = rx->user_data;
+		modbus_rsp_parser_init(&parser, &bridge->reqs);
+		status = IS_ENABLED(CONFIG_BRIDGE_MODBUS_FRAMING) ?
+			 MODBUS_RSP_INCOMPLETE : MODBUS_RSP_MALFORMED;
+
+		/* Gather the received packets until the response frame is
+		 * complete. Data that cannot be framed is flushed when the link
+		 * goes quiet. Bytes following a complete frame are kept for the
+		 * next one.
+		 */
+		while (rx) {
+			uint16_t end = rx->len;
+
+			if (status == MODBUS_RSP_INCOMPLETE) {
+				size_t used;
+
+				status = modbus_rsp_parser_feed(&parser, &rx->data[loc],
+								rx->len - loc, &used);
+				if (status == MODBUS_RSP_MALFORMED) {
+					LOG_DBG("Response not framed, waiting for timeout");
+				}
+				end = loc + used;
+			}
+
+			while (loc < end) {
+				uint16_t plen = MIN(sizeof(tx->data) - tx->len, end - loc);
+
+				memcpy(&tx->data[tx->len], &rx->data[loc], plen);
+				tx->len += plen;
+				loc += plen;
+
+				if (tx->len == sizeof(tx->data)) {
+					LOG_DBG("uart tx buffer full");
+					uart_tx_frame(bridge, tx);
+
+					tx = uart_buf_alloc(bridge);
+					if (!tx) {
+						LOG_WRN("Could not allocate UART tx buffer!");
+						break;
+					}
+				}
+			}
+
+			if (!tx || (loc == rx->len)) {
+				k_heap_free(bridge->heap, rx);
+				rx = NULL;
+			}
+
+			if (!tx || (status == MODBUS_RSP_COMPLETE)) {
+				break;
+			}
+
+			rx = k_fifo_get(&bridge->tx_fifo,
+					K_MSEC(CONFIG_BRIDGE_FRAME_TIMEOUT_MS));
+			loc = 0;
+			if (!rx && (status == MODBUS_RSP_INCOMPLETE)) {
+				LOG_WRN("Incomplete response frame, len: %u", tx->len);
+			}
+		}
+
+		if (tx) {
+			rsp_flush(bridge, tx, status);
+		}
+
+		if (rsp_done_cb && (status == MODBUS_RSP_COMPLETE)) {
+			rsp_done_cb(bridge, user_data);
+		}
+	}
+}
+
+static int bridge_init(struct uart_bridge *bridge, k_thread_stack_t *stack)
+{
+	struct uart_data_t *rx;
+	int err;
+
+	if (!device_is_ready(bridge->uart)) {
+		LOG_ERR("UART device %s not ready", bridge->uart->name);
+		return -ENODEV;
+	}
+
+	k_fifo_init(&bridge->rx_fifo);
+	k_fifo_init(&bridge->tx_fifo);
+	k_work_init_delayable(&bridge->rx_work, rx_work_handler);
+	k_work_init_delayable(&bridge->dtr_work, dtr_work_handler);
+
+	k_thread_create(&bridge->tx_thread, stack,
+			CONFIG_BRIDGE_UART_THREAD_STACK_SIZE, tx_thread,
+			bridge, NULL, NULL, PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&bridge->tx_thread, bridge->uart->name);
+
+	if (IS_ENABLED(CONFIG_UART_ASYNC_ADAPTER) && !uart_test_async_api(bridge->uart)) {
+		/* Implement API adapter */
+		uart_async_adapter_init(bridge->async_adapter, bridge->uart);
+		bridge->uart = bridge->async_adapter;
+	}
+
+	err = uart_callback_set(bridge->uart, uart_cb, bridge);
+	if (err) {
+		return err;
+	}
+
+	if (IS_ENABLED(CONFIG_UART_LINE_CTRL)) {
+		/* Reception is started once the host sets DTR, without holding
+		 * up the Bluetooth bring-up.
+		 */
+		LOG_INF("%s: Wait for DTR", bridge->uart->name);
+		k_work_reschedule(&bridge->dtr_work, K_NO_WAIT);
+		return 0;
+	}
+
+	rx = uart_buf_alloc(bridge);
+	if (!rx) {
+		return -ENOMEM;
+	}
+
+	err = uart_rx_enable(bridge->uart, rx->data, sizeof(rx->data), UART_RX_TIMEOUT);
+	if (err) {
+		LOG_ERR("Cannot enable uart reception (err: %d)", err);
+		/* Free the rx buffer only because the tx buffer will be handled in the callback */
+		k_heap_free(bridge->heap, rx);
+		return err;
+	}
+
+	bridge->ready_time = k_uptime_get();
+
+	return 0;
+}
+
+struct uart_bridge *uart_bridge_get(size_t idx)
+{
+	__ASSERT_NO_MSG(idx < ARRAY_SIZE(bridges));
+
+	return &bridges[idx];
+}
+
+int uart_bridge_init(uart_bridge_rsp_done_cb_t rsp_done)
+{
+	int err;
+
+	rsp_done_cb = rsp_done;
+	adapters_set();
+
+	for (size_t i = 0; i < ARRAY_SIZE(bridges); i++) {
+		err = bridge_init(&bridges[i], tx_thread_stacks[i]);
+		if (err) {
+			return err;
+		}
+
+		LOG_INF("UART %s bridged to %s", bridges[i].uart->name,
+			bridges[i].peer_name ? bridges[i].peer_name : "first free peripheral");
+	}
+
+	return 0;
+}
+
+int uart_bridge_put(struct uart_bridge *bridge, const uint8_t *data, uint16_t len,
+		    void *user_data)
+{
+	struct nus_data_t *buf = k_heap_alloc(bridge->heap, sizeof(*buf) + len, K_NO_WAIT);
+
+	if (!buf) {
+		LOG_WRN("Not able to allocate UART send data buffer");
+		return -ENOMEM;
+	}
+
+	memcpy(buf->data, data, len);
+	buf->len = len;
+	buf->user_data = user_data;
+
+	LOG_DBG("UART TX -> FIFO, len: %u", buf->len);
+	k_fifo_put(&bridge->tx_fifo, buf);
+
+	return 0;
+}
+
+void uart_bridge_free(struct uart_bridge *bridge, struct uart_data_t *buf)
+{
+	k_heap_free(bridge->heap, buf);
+}
+
+bool uart_bridge_unit_allowed(const struct uart_bridge *bridge, uint8_t unit)
+{
+	if ((bridge->unit_id_cnt == 0) || (unit == MODBUS_UNIT_BROADCAST)) {
+		return true;
+	}
+
+	for (size_t i = 0; i < bridge->unit_id_cnt; i++) {
+		if (bridge->unit_ids[i] == unit) {
+			return true;
+		}
+	}
+
+	return false;
+}
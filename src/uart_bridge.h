@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef UART_BRIDGE_H_
+#define UART_BRIDGE_H_
+
+/** @file
+ *  @brief UART bridge instances
+ *
+ *  Each UART connected to a Modbus master is served by its own bridge
+ *  instance, with its own callback state, receive and transmit queues,
+ *  buffer pool, request table and transmit thread. The instances are
+ *  defined with the nordic,nus-uart-bridge devicetree compatible. Without
+ *  any such node, a single instance is created for the UART selected with
+ *  the nordic,nus-uart chosen node.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/kernel.h>
+
+#include "crc16_modbus.h"
+#include "modbus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if DT_HAS_COMPAT_STATUS_OKAY(nordic_nus_uart_bridge)
+#define UART_BRIDGE_COUNT DT_NUM_INST_STATUS_OKAY(nordic_nus_uart_bridge)
+#else
+#define UART_BRIDGE_COUNT 1
+#endif
+
+/** UART payload buffer element size. */
+#define UART_BUF_SIZE 740
+
+/** @brief Frame received on the UART. */
+struct uart_data_t {
+	void *fifo_reserved;
+	uint8_t  data[UART_BUF_SIZE];
+	uint16_t len;
+	/* CRC over received data, updated as it arrives. */
+	struct crc16_modbus_ctx crc;
+};
+
+/** @brief Bridge instance. */
+struct uart_bridge {
+	/** UART the Modbus master is connected to. */
+	const struct device *uart;
+	/** Asynchronous API adapter, used if the UART driver lacks it. */
+	const struct device *async_adapter;
+	/** Device name of the peripheral bridged to the UART, or NULL to use
+	 *  the first peripheral not claimed by another instance.
+	 */
+	const char *peer_name;
+	/** Unit IDs the master is allowed to address, all if none. */
+	const uint8_t *unit_ids;
+	size_t unit_id_cnt;
+	/** Pool the receive and transmit buffers are taken from. */
+	struct k_heap *heap;
+	/** Frames received on the UART, for the peripheral. */
+	struct k_fifo rx_fifo;
+	/** Data received from the peripheral, for the UART. */
+	struct k_fifo tx_fifo;
+	/** Requests sent on behalf of the master. */
+	struct modbus_req_table reqs;
+	/** Time at which UART reception was started, 0 until then. */
+	int64_t ready_time;
+
+	/* Private. */
+	struct k_work_delayable rx_work;
+	struct k_work_delayable dtr_work;
+	uint8_t *aborted_buf;
+	size_t aborted_len;
+	bool disable_req;
+	struct k_thread tx_thread;
+};
+
+/** @brief Callback for the end of a response sent out on the UART.
+ *
+ *  Called from the transmit thread of the bridge once a complete Modbus
+ *  response frame has been received. Data that cannot be framed, or is
+ *  left incomplete, does not end a response.
+ *
+ *  @param bridge Bridge instance.
+ *  @param user_data User data queued with the first byte of the response.
+ */
+typedef void (*uart_bridge_rsp_done_cb_t)(struct uart_bridge *bridge, void *user_data);
+
+/** @brief Get a bridge instance.
+ *
+ *  @param idx Index of the instance, less than @ref UART_BRIDGE_COUNT.
+ *
+ *  @return Bridge instance.
+ */
+struct uart_bridge *uart_bridge_get(size_t idx);
+
+/** @brief Initialize the bridge instances.
+ *
+ *  Starts reception on each UART, or waits for DTR when
+ *  CONFIG_UART_LINE_CTRL is enabled, and starts the threads sending the
+ *  responses out on the UARTs.
+ *
+ *  @param rsp_done Callback for the end of each response, or NULL.
+ *
+ *  @return 0 on success, negative error code otherwise.
+ */
+int uart_bridge_init(uart_bridge_rsp_done_cb_t rsp_done);
+
+/** @brief Queue data received from the peripheral for the UART.
+ *
+ *  @param bridge Bridge instance.
+ *  @param data Received data.
+ *  @param len Length of the data.
+ *  @param user_data Identifies the source of the data to the response
+ *                   callback.
+ *
+ *  @return 0 on success, negative error code otherwise.
+ */
+int uart_bridge_put(struct uart_bridge *bridge, const uint8_t *data, uint16_t len,
+		    void *user_data);
+
+/** @brief Release a frame taken from the receive queue.
+ *
+ *  @param bridge Bridge instance.
+ *  @param buf Frame to release.
+ */
+void uart_bridge_free(struct uart_bridge *bridge, struct uart_data_t *buf);
+
+/** @brief Check if the master may address a unit.
+ *
+ *  @param bridge Bridge instance.
+ *  @param unit Unit ID of the request.
+ *
+ *  @return true if the request may be bridged.
+ */
+bool uart_bridge_unit_allowed(const struct uart_bridge *bridge, uint8_t unit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UART_BRIDGE_H_ */